@@ -4,60 +4,233 @@
 
 #include "cards.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <iostream>
 
 
-const std::unordered_map<int, char>  position_no_to_char = {{0, 'N'}, {1, 'E'}, {2, 'S'}, {3, 'W'}};
-const std::unordered_map<int, char>  char_to_position_no = {{'N', 0}, {'E', 1}, {'S', 2}, {'W', 3}};
+// Points for taking a card, by round type and card_index().
+// Round 7 is the sum of rounds 1-6.
+static constexpr auto card_penalty = [] {
+    std::array<std::array<uint8_t, CARDS_IN_DECK>, NO_OF_ROUND_TYPES + 1> table{};
+    for (int round_type = 1; round_type <= NO_OF_ROUND_TYPES; round_type++) {
+        bool all = round_type == NO_OF_ROUND_TYPES;
+        for (int index = 0; index < CARDS_IN_DECK; index++) {
+            int color = index / CARDS_PER_COLOR + 1;
+            int value = index % CARDS_PER_COLOR + static_cast<int>(card_value_t::TWO);
+            int points = 0;
+            if ((all || round_type == 2) && color == static_cast<int>(card_color_t::H)) {
+                points += 1;
+            }
+            if ((all || round_type == 3) && value == static_cast<int>(card_value_t::Q)) {
+                points += 5;
+            }
+            if ((all || round_type == 4) &&
+                (value == static_cast<int>(card_value_t::K) || value == static_cast<int>(card_value_t::J))) {
+                points += 2;
+            }
+            if ((all || round_type == 5) && value == static_cast<int>(card_value_t::K) &&
+                color == static_cast<int>(card_color_t::H)) {
+                points += 18;
+            }
+            table[round_type][index] = points;
+        }
+    }
+    return table;
+}();
+
+// Points for taking a trick regardless of its cards, by round type and trick number.
+static constexpr auto trick_bonus = [] {
+    std::array<std::array<uint8_t, MAX_TRICKS_PER_ROUND + 1>, NO_OF_ROUND_TYPES + 1> table{};
+    for (int round_type = 1; round_type <= NO_OF_ROUND_TYPES; round_type++) {
+        bool all = round_type == NO_OF_ROUND_TYPES;
+        for (int trick_number = 1; trick_number <= MAX_TRICKS_PER_ROUND; trick_number++) {
+            int points = 0;
+            if (all || round_type == 1) {
+                points += 1;
+            }
+            if ((all || round_type == 6) && (trick_number == 7 || trick_number == 13)) {
+                points += 10;
+            }
+            table[round_type][trick_number] = points;
+        }
+    }
+    return table;
+}();
 
-const std::unordered_map<card_color_t, char> color_to_char = {{card_color_t::C, 'C'}, {card_color_t::D, 'D'}, {card_color_t::H, 'H'}, {card_color_t::S, 'S'}};
-const std::unordered_map<char, card_color_t> char_to_color = {{'C', card_color_t::C}, {'D', card_color_t::D}, {'H', card_color_t::H}, {'S', card_color_t::S}};
-const std::unordered_map<card_value_t, std::string> value_to_string = {{card_value_t::NONE, "NONE"},{card_value_t::TWO, "2"}, {card_value_t::THREE, "3"}, {card_value_t::FOUR, "4"}, {card_value_t::FIVE, "5"}, {card_value_t::SIX, "6"}, {card_value_t::SEVEN, "7"}, {card_value_t::EIGHT, "8"}, {card_value_t::NINE, "9"}, {card_value_t::TEN, "10"}, {card_value_t::J, "J"}, {card_value_t::Q, "Q"}, {card_value_t::K, "K"}, {card_value_t::A, "A"}};
-const std::unordered_map<std::string, card_value_t> string_to_value = {{"2", card_value_t::TWO}, {"3", card_value_t::THREE}, {"4", card_value_t::FOUR}, {"5", card_value_t::FIVE}, {"6", card_value_t::SIX}, {"7", card_value_t::SEVEN}, {"8", card_value_t::EIGHT}, {"9", card_value_t::NINE}, {"10", card_value_t::TEN}, {"J", card_value_t::J}, {"Q", card_value_t::Q}, {"K", card_value_t::K}, {"A", card_value_t::A}};
+static constexpr int points_in_round(int round_type) {
+    int points = 0;
+    for (int index = 0; index < CARDS_IN_DECK; index++) {
+        points += card_penalty[round_type][index];
+    }
+    for (int trick_number = 1; trick_number <= MAX_TRICKS_PER_ROUND; trick_number++) {
+        points += trick_bonus[round_type][trick_number];
+    }
+    return points;
+}
 
-const std::unordered_map<Position, char> position_to_char = {{Position::N, 'N'}, {Position::E, 'E'}, {Position::S, 'S'}, {Position::W, 'W'}};
-const std::unordered_map<char, Position> char_to_position = {{'N', Position::N}, {'E', Position::E}, {'S', Position::S}, {'W', Position::W}};
+static_assert([] {
+    for (int round_type = 1; round_type <= NO_OF_ROUND_TYPES; round_type++) {
+        if (points_in_round(round_type) != max_points_per_round[round_type]) {
+            return false;
+        }
+    }
+    return true;
+}(), "penalty tables have to agree with max_points_per_round");
 
-const std::unordered_map<int, int> max_points_per_round = {{1, 13}, {2, 13}, {3, 20}, {4, 16}, {5, 18}, {6, 20}, {7, 100}};
+// Position of the card in a CardSet mask, 0-51. c has to be a real card.
+int card_index(Card c) {
+    return std::countr_zero(CardSet::bit_of(c));
+}
 
-Card::Card(card_color_t color, card_value_t value) : color(color), value(value) {}
+// Points for taking c in a round of the given type, not counting
+// the points for the trick itself.
+int card_points(int round_type, Card c) {
+    return card_penalty[round_type][card_index(c)];
+}
 
-Card::Card(int color, int value) : color(static_cast<card_color_t>(color)), value(static_cast<card_value_t>(value)) {}
+static Card card_of_bit(int bit) {
+    return {bit / CARDS_PER_COLOR + 1, bit % CARDS_PER_COLOR + static_cast<int>(card_value_t::TWO)};
+}
 
-bool Card::operator<(const Card &other) const {
-    return static_cast<int>(color) < static_cast<int>(other.get_color())
-           || (color == other.get_color()
-               && this->num_value() < other.num_value());
+CardSet::iterator::iterator() : rest(0) {}
+
+CardSet::iterator::iterator(uint64_t rest) : rest(rest) {}
+
+Card CardSet::iterator::operator*() const {
+    return card_of_bit(std::countr_zero(this->rest));
 }
 
-bool Card::operator==(const Card &other) const {
-    return this->color == other.get_color() && this->value == other.get_value();
+CardSet::iterator &CardSet::iterator::operator++() {
+    this->rest &= this->rest - 1;
+    return *this;
 }
 
-card_color_t Card::get_color() const {
-    return this->color;
+CardSet::iterator CardSet::iterator::operator++(int) {
+    iterator old = *this;
+    ++*this;
+    return old;
 }
 
-card_value_t Card::get_value() const {
-    return this->value;
+bool CardSet::iterator::operator==(const iterator &other) const {
+    return this->rest == other.rest;
 }
 
-int Card::num_value() const {
-    return static_cast<int>(this->value);
+CardSet::CardSet() : mask(0) {}
+
+CardSet::CardSet(uint64_t mask) : mask(mask) {}
+
+// Returns 0 for cards without a color or a value.
+uint64_t CardSet::bit_of(Card c) {
+    int color = static_cast<int>(c.get_color());
+    int value = c.num_value();
+    if (color == 0 || value < static_cast<int>(card_value_t::TWO)) {
+        return 0;
+    }
+    return uint64_t{1} << ((color - 1) * CARDS_PER_COLOR + value - static_cast<int>(card_value_t::TWO));
 }
 
+uint64_t CardSet::color_bits(card_color_t c) {
+    int color = static_cast<int>(c);
+    if (color == 0) {
+        return 0;
+    }
+    return ((uint64_t{1} << CARDS_PER_COLOR) - 1) << ((color - 1) * CARDS_PER_COLOR);
+}
 
+void CardSet::insert(Card c) {
+    this->mask |= bit_of(c);
+}
 
-Trick::Trick(Position starting_player, int trick_number, int round_type) : taking_card(
+void CardSet::erase(Card c) {
+    this->mask &= ~bit_of(c);
+}
+
+bool CardSet::contains(Card c) const {
+    uint64_t bit = bit_of(c);
+    return bit != 0 && (this->mask & bit) != 0;
+}
+
+int CardSet::size() const {
+    return std::popcount(this->mask);
+}
+
+bool CardSet::empty() const {
+    return this->mask == 0;
+}
+
+uint64_t CardSet::get_mask() const {
+    return this->mask;
+}
+
+CardSet CardSet::of_color(card_color_t c) const {
+    return CardSet(this->mask & color_bits(c));
+}
+
+bool CardSet::has_color(card_color_t c) const {
+    return (this->mask & color_bits(c)) != 0;
+}
+
+// Returns a card with no color and value if the set is empty.
+Card CardSet::highest() const {
+    if (this->mask == 0) {
+        return {card_color_t::NONE, card_value_t::NONE};
+    }
+    return card_of_bit(63 - std::countl_zero(this->mask));
+}
+
+// Returns a card with no color and value if the set is empty.
+Card CardSet::lowest() const {
+    if (this->mask == 0) {
+        return {card_color_t::NONE, card_value_t::NONE};
+    }
+    return card_of_bit(std::countr_zero(this->mask));
+}
+
+Card CardSet::highest_of_color(card_color_t c) const {
+    return this->of_color(c).highest();
+}
+
+// The biggest card of the same color as c that is smaller than c.
+Card CardSet::highest_below(Card c) const {
+    uint64_t bit = bit_of(c);
+    return CardSet(this->mask & color_bits(c.get_color()) & (bit - 1)).highest();
+}
+
+// Cards that may be played to a trick led with leading_color
+// (card_color_t::NONE if the trick is empty): a player has to follow
+// the leading color if they can.
+CardSet CardSet::legal_moves(card_color_t leading_color) const {
+    CardSet following = this->of_color(leading_color);
+    return following.empty() ? *this : following;
+}
+
+CardSet::iterator CardSet::begin() const {
+    return iterator(this->mask);
+}
+
+CardSet::iterator CardSet::end() const {
+    return iterator(0);
+}
+
+bool CardSet::operator==(const CardSet &other) const {
+    return this->mask == other.mask;
+}
+
+
+
+Trick::Trick() : Trick(Position::N, 0, 0) {}
+
+Trick::Trick(Position starting_player, int trick_number, int round_type) : played_cards{}, taking_card(
         Card(card_color_t::NONE, card_value_t::NONE)) {
     this->starting_player = starting_player;
     this->current_player = starting_player;
     this->no_played_cards = 0;
     this->leading_color = card_color_t::NONE;
-    this->played_cards = std::vector<Card>();
     this->taking_player = starting_player;
-    this->trick_number = trick_number;
-    this->round_type = round_type;
+    this->trick_number = static_cast<int8_t>(trick_number);
+    this->round_type = static_cast<int8_t>(round_type);
 }
 
 Position Trick::get_starting_player() const {
@@ -90,8 +263,7 @@ void Trick::add_card(Card c) {
         this->taking_card = c;
         this->taking_player = this->current_player;
     }
-    this->played_cards.push_back(c);
-    this->no_played_cards++;
+    this->played_cards[this->no_played_cards++] = c;
     if (c.get_color() == this->taking_card.get_color() && this->taking_card < c) {
         this->taking_card = c;
         this->taking_player = this->current_player;
@@ -101,72 +273,30 @@ void Trick::add_card(Card c) {
 }
 
 int Trick::evaluate_trick() {
-    int result{0};
-    switch (this->round_type) {
-        case 7:
-            [[fallthrough]];
-        case 1:
-            result += 1;
-            if (this->round_type == 1) {
-                break;
-            }
-            [[fallthrough]];
-        case 2:
-            for (const auto &card: this->played_cards) {
-                if (card.get_color() == card_color_t::H) {
-                    result++;
-                }
-            }
-            if (this->round_type == 2) {
-                break;
-            }
-            [[fallthrough]];
-        case 3:
-            for (const auto &card: this->played_cards) {
-                if (card.get_value() == card_value_t::Q) {
-                    result += 5;
-                }
-            }
-            if (this->round_type == 3) {
-                break;
-            }
-            [[fallthrough]];
-        case 4:
-
-            for (const auto &card: this->played_cards) {
-                if (card.get_value() == card_value_t::K || card.get_value() == card_value_t::J) {
-                    result += 2;
-                }
-            }
-            if (this->round_type == 4) {
-                break;
-            }
-            [[fallthrough]];
-        case 5:
-            for (const auto &card: this->played_cards) {
-                if (card.get_value() == card_value_t::K && card.get_color() == card_color_t::H) {
-                    result += 18;
-                }
-            }
-            if (this->round_type == 5) {
-                break;
-            }
-            [[fallthrough]];
-        case 6:
-                if (this->trick_number == 7 || this->trick_number == 13) {
-                    result += 10;
+    int result = trick_bonus[this->round_type][this->trick_number];
+    for (Card card: this->get_played_cards()) {
+        result += card_penalty[this->round_type][card_index(card)];
+    }
+    return result;
+}
 
-            }
-            if (this->round_type == 6) {
-                break;
-            }
-        default:
-            break;
+int evaluate_trick_cards(const TrickCards &t) {
+    int result = trick_bonus[t.round_type][t.trick_number];
+    for (uint64_t rest = t.cards.get_mask(); rest != 0; rest &= rest - 1) {
+        result += card_penalty[t.round_type][std::countr_zero(rest)];
     }
     return result;
 }
 
-Round::Round(int round_type, Position starting_player, std::string starting_hands[4]) : scores{0, 0, 0, 0} {
+// Scores tricks[i] into scores[i], for analysing many tricks at once.
+void evaluate_tricks(std::span<const TrickCards> tricks, std::span<int> scores) {
+    size_t count = std::min(tricks.size(), scores.size());
+    for (size_t i = 0; i < count; i++) {
+        scores[i] = evaluate_trick_cards(tricks[i]);
+    }
+}
+
+Round::Round(int round_type, Position starting_player, const std::string_view starting_hands[4]) : scores{0, 0, 0, 0} {
     this->round_type = round_type;
     this->starting_player = starting_player;
     for (int i = 0; i < 4; i++) {
@@ -196,114 +326,214 @@ void Round::add_points(int p, Position pos) {
     this->scores[static_cast<int>(pos)] += p;
 }
 
-Position get_start_pos_from_sett(std::string &s) {
-    size_t length = s.size();
-    char start_pos = s[length - 1];
-    switch (start_pos) {
-        case 'N':
-            return Position::N;
-        case 'E':
-            return Position::E;
-        case 'S':
-            return Position::S;
-        case 'W':
-            return Position::W;
-        default:
-            return Position::N;
-    }
-}
-
-std::set<Card> create_card_set_from_string(const std::string &s) {
-    std::set<Card> cards{};
-    int i{0};
-    while (s[i] != '\0') {
-        card_value_t value;
-        card_color_t color;
-        switch (s[i]) {
-            case '1':
-                if (s[++i] != '0') {
-                    value = card_value_t::NONE;
-                    break;
-                }
-                value = card_value_t::TEN;
-                break;
-
-            case '2':
-                value = card_value_t::TWO;
-                break;
-            case '3':
-                value = card_value_t::THREE;
-                break;
-            case '4':
-                value = card_value_t::FOUR;
-                break;
-            case '5':
-                value = card_value_t::FIVE;
-                break;
-            case '6':
-                value = card_value_t::SIX;
-                break;
-            case '7':
-                value = card_value_t::SEVEN;
-                break;
-            case '8':
-                value = card_value_t::EIGHT;
-                break;
-            case '9':
-                value = card_value_t::NINE;
-                break;
-            case 'J':
-                value = card_value_t::J;
-                break;
-            case 'Q':
-                value = card_value_t::Q;
-                break;
-            case 'K':
-                value = card_value_t::K;
-                break;
-            case 'A':
-                value = card_value_t::A;
-                break;
-            default:
-                value = card_value_t::NONE;
+
+// Parses one card ("10" or [23456789JQKA], then [CDHS]) starting at s[i].
+// On success moves i past the card, otherwise leaves it unchanged.
+bool parse_card(std::string_view s, size_t &i, Card &c) {
+    size_t j = i;
+    if (j + 1 >= s.size()) {
+        return false;
+    }
+    card_value_t value = string_to_value(s.substr(j, 1));
+    if (s[j] == '1' && s[j + 1] == '0') {
+        value = card_value_t::TEN;
+        j++;
+    }
+    if (value == card_value_t::NONE || ++j >= s.size()) {
+        return false;
+    }
+    card_color_t color = char_to_color(s[j]);
+    if (color == card_color_t::NONE) {
+        return false;
+    }
+    c = Card(color, value);
+    i = j + 1;
+    return true;
+}
+
+// Parses s[i..] as a list of at most max_cards cards with nothing after them.
+static bool parse_card_list(std::string_view s, size_t i, Card *cards, int max_cards, int &no_cards) {
+    no_cards = 0;
+    while (i < s.size()) {
+        if (no_cards == max_cards || !parse_card(s, i, cards[no_cards])) {
+            return false;
         }
+        no_cards++;
+    }
+    return true;
+}
+
+// Parses prefix, a trick number 1-13 and up to max_cards cards.
+// "1" followed by 0-3 is read as a two-digit number only if the rest is
+// still a valid list of cards; otherwise the number is the single digit,
+// so "TRICK110C" is trick 1 with 10C (a card never starts with 0-3).
+static bool parse_numbered_cards(std::string_view s, std::string_view prefix, Card *cards, int max_cards,
+                                 int &no_cards, int &trick_number) {
+    if (!s.starts_with(prefix) || s.size() == prefix.size()) {
+        return false;
+    }
+    size_t i = prefix.size();
+    char first = s[i];
+    if (first < '1' || first > '9') {
+        return false;
+    }
+    if (first == '1' && i + 1 < s.size() && s[i + 1] >= '0' && s[i + 1] <= '3' &&
+        parse_card_list(s, i + 2, cards, max_cards, no_cards)) {
+        trick_number = 10 + (s[i + 1] - '0');
+        return true;
+    }
+    if (parse_card_list(s, i + 1, cards, max_cards, no_cards)) {
+        trick_number = first - '0';
+        return true;
+    }
+    return false;
+}
+
+// "TRICK", a trick number 1-13 and at most three cards, nothing else.
+bool parse_trick_message(std::string_view s, TrickMessage &m) {
+    return parse_numbered_cards(s, "TRICK", m.cards, NO_OF_PLAYERS - 1, m.no_cards, m.trick_number);
+}
+
+static bool parse_position(char c, Position &p) {
+    int no = char_to_position_no(c);
+    if (no < 0) {
+        return false;
+    }
+    p = static_cast<Position>(no);
+    return true;
+}
+
+// "TAKEN", a trick number 1-13, exactly four cards and the seat taking them.
+bool parse_taken_message(std::string_view s, TakenMessage &m) {
+    if (s.empty() || !parse_position(s.back(), m.taking_player)) {
+        return false;
+    }
+    int no_cards;
+    return parse_numbered_cards(s.substr(0, s.size() - 1), "TAKEN", m.cards, NO_OF_PLAYERS, no_cards,
+                                m.trick_number) && no_cards == NO_OF_PLAYERS;
+}
+
+// Parses s[i..] as a non-negative number taking all the digits there are.
+static bool parse_number(std::string_view s, size_t &i, int &n) {
+    size_t start = i;
+    n = 0;
+    while (i < s.size() && s[i] >= '0' && s[i] <= '9' && i - start < 9) {
+        n = n * 10 + (s[i] - '0');
         i++;
-        switch (s[i]) {
-            case 'C':
-                color = card_color_t::C;
-                break;
-            case 'D':
-                color = card_color_t::D;
-                break;
-            case 'H':
-                color = card_color_t::H;
-                break;
-            case 'S':
-                color = card_color_t::S;
-                break;
-            default:
-                color = card_color_t::NONE;
+    }
+    return i > start && (i == s.size() || s[i] < '0' || s[i] > '9');
+}
+
+// "BUSY" followed by one to four distinct seats.
+static bool parse_busy(std::string_view s, ServerMessage &m) {
+    m.busy.seats = 0;
+    for (size_t i = 4; i < s.size(); i++) {
+        Position p;
+        if (!parse_position(s[i], p) || (m.busy.seats & (1u << static_cast<int>(p))) != 0) {
+            return false;
+        }
+        m.busy.seats |= 1u << static_cast<int>(p);
+    }
+    return m.busy.seats != 0;
+}
+
+// "DEAL", the round type, the starting player and 13 distinct cards.
+static bool parse_deal(std::string_view s, ServerMessage &m) {
+    if (s.size() < 6 || s[4] < '1' || s[4] > '0' + NO_OF_ROUND_TYPES ||
+        !parse_position(s[5], m.deal.starting_player)) {
+        return false;
+    }
+    m.deal.round_type = s[4] - '0';
+    m.deal.hand = CardSet();
+    size_t i = 6;
+    while (i < s.size()) {
+        Card c;
+        if (!parse_card(s, i, c) || m.deal.hand.contains(c)) {
+            return false;
+        }
+        m.deal.hand.insert(c);
+    }
+    return m.deal.hand.size() == MAX_TRICKS_PER_ROUND;
+}
+
+static bool parse_trick(std::string_view s, ServerMessage &m) {
+    return parse_trick_message(s, m.trick);
+}
+
+static bool parse_wrong(std::string_view s, ServerMessage &m) {
+    size_t i = 5;
+    return parse_number(s, i, m.wrong.trick_number) && i == s.size();
+}
+
+static bool parse_taken(std::string_view s, ServerMessage &m) {
+    return parse_taken_message(s, m.taken);
+}
+
+// SCORE or TOTAL: every seat once, in any order, followed by its points.
+static bool parse_score(std::string_view s, ServerMessage &m) {
+    unsigned seen = 0;
+    size_t i = 5;
+    while (i < s.size()) {
+        Position p;
+        if (!parse_position(s[i], p) || (seen & (1u << static_cast<int>(p))) != 0) {
+            return false;
         }
+        seen |= 1u << static_cast<int>(p);
         i++;
-        cards.insert(Card(color, value));
+        if (!parse_number(s, i, m.score.scores[static_cast<int>(p)])) {
+            return false;
+        }
     }
-    return cards;
+    return seen == (1u << NO_OF_PLAYERS) - 1;
+}
+
+struct MessageParser {
+    std::string_view keyword;
+    ServerMessageType type;
+    bool (*parse)(std::string_view s, ServerMessage &m);
+};
+
+static constexpr MessageParser server_message_parsers[] = {
+        {"TRICK", ServerMessageType::TRICK, parse_trick},
+        {"TAKEN", ServerMessageType::TAKEN, parse_taken},
+        {"DEAL",  ServerMessageType::DEAL,  parse_deal},
+        {"SCORE", ServerMessageType::SCORE, parse_score},
+        {"TOTAL", ServerMessageType::TOTAL, parse_score},
+        {"WRONG", ServerMessageType::WRONG, parse_wrong},
+        {"BUSY",  ServerMessageType::BUSY,  parse_busy},
+};
+
+// Decodes a message from the server, without its CRLF, and without
+// allocating. The keyword picks the parser; a message that does not
+// parse gets the type UNKNOWN and false is returned.
+bool parse_server_message(std::string_view s, ServerMessage &m) {
+    for (const MessageParser &parser: server_message_parsers) {
+        if (s.starts_with(parser.keyword)) {
+            m.type = parser.type;
+            if (parser.parse(s, m)) {
+                return true;
+            }
+            break;
+        }
+    }
+    m.type = ServerMessageType::UNKNOWN;
+    return false;
 }
 
 void Card::print_card() const {
-    std::cout << value_to_string.at(this->value) << color_to_char.at(this->color);
+    std::cout << value_text[this->num_value()] << color_text[static_cast<int>(this->get_color())];
 }
 
-std::string Round::get_starting_hand(Position pos) const {
+std::string_view Round::get_starting_hand(Position pos) const {
     return this->starting_hands[static_cast<int>(pos)];
 }
 
-std::vector<Trick>& Round::get_played_tricks(){
-    return this->played_tricks;
+std::span<const Trick> Round::get_played_tricks() const {
+    return {this->played_tricks, static_cast<size_t>(this->finished_tricks_by_now)};
 }
 
-std::vector<Card>& Trick::get_played_cards(){
-    return this->played_cards;
+std::span<const Card> Trick::get_played_cards() const {
+    return {this->played_cards, static_cast<size_t>(this->no_played_cards)};
 }
 
 int Trick::get_trick_number() const {
@@ -314,87 +544,10 @@ int Trick::get_round_type() const {
     return this->round_type;
 }
 
-std::vector<Card> create_card_vector_from_string(const std::string& s) {
-    std::vector<Card> cards{};
-    int i{0};
-    while (s[i] != '\0') {
-        card_value_t value;
-        card_color_t color;
-        switch (s[i]) {
-            case '1':
-                if (s[++i] != '0') {
-                    value = card_value_t::NONE;
-                    break;
-                }
-                value = card_value_t::TEN;
-                break;
-
-            case '2':
-                value = card_value_t::TWO;
-                break;
-            case '3':
-                value = card_value_t::THREE;
-                break;
-            case '4':
-                value = card_value_t::FOUR;
-                break;
-            case '5':
-                value = card_value_t::FIVE;
-                break;
-            case '6':
-                value = card_value_t::SIX;
-                break;
-            case '7':
-                value = card_value_t::SEVEN;
-                break;
-            case '8':
-                value = card_value_t::EIGHT;
-                break;
-            case '9':
-                value = card_value_t::NINE;
-                break;
-            case 'J':
-                value = card_value_t::J;
-                break;
-            case 'Q':
-                value = card_value_t::Q;
-                break;
-            case 'K':
-                value = card_value_t::K;
-                break;
-            case 'A':
-                value = card_value_t::A;
-                break;
-            default:
-                value = card_value_t::NONE;
-        }
-        i++;
-        switch (s[i]) {
-            case 'C':
-                color = card_color_t::C;
-                break;
-            case 'D':
-                color = card_color_t::D;
-                break;
-            case 'H':
-                color = card_color_t::H;
-                break;
-            case 'S':
-                color = card_color_t::S;
-                break;
-            default:
-                color = card_color_t::NONE;
-        }
-        i++;
-        cards.emplace_back(color, value);
-    }
-    return cards;
-}
-
 int Round::get_score(int i) const {
     return this->scores[i];
 }
 
 void Round::add_trick(const Trick &t) {
-    this->played_tricks.push_back(t);
+    this->played_tricks[this->finished_tricks_by_now++] = t;
 }
\ No newline at end of file
@@ -6,25 +6,24 @@
 #define KIERKI_CARDS_H
 
 
-#include <unordered_map>
-#include <regex>
-#include "common.h"
+#include <array>
+#include <cinttypes>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
+#define NO_OF_PLAYERS 4
+#define NO_OF_ROUND_TYPES 7
 
-constexpr std::string_view value_regex_string = "(10|[23456789JQKA])";
-const std::string_view color_regex_string = "[CDHS]";
-const std::string_view trick_number_regex_string = "[123456789(10)(11)(12)(13)]";
-const std::string_view card_regex_string = "(10|[23456789JQKA])[CDHS]";
 
-const std::string trick_regex_string = "TRICK((1[0-3])|[123456789])((10|[23456789JQKA])([CDHS])){0,3}";
+// Points to be taken in a round, by round type.
+constexpr int max_points_per_round[NO_OF_ROUND_TYPES + 1] = {0, 13, 13, 20, 16, 18, 20, 100};
 
-const std::string taken_regex_string = "TAKEN((1[0-3])|[123456789])((10|[23456789JQKA])([CDHS])){4}([NESW])";
 
-extern const std::unordered_map<int, int> max_points_per_round;
 
-
-
-enum class card_color_t {
+enum class card_color_t : uint8_t {
     NONE = 0,
     C,
     S,
@@ -32,7 +31,7 @@ enum class card_color_t {
     H,
 };
 
-enum class card_value_t {
+enum class card_value_t : uint8_t {
     NONE = 0,
     TWO = 2,
     THREE,
@@ -49,53 +48,187 @@ enum class card_value_t {
     A,
 };
 
-extern const std::unordered_map<card_color_t, char> color_to_char;
-extern const std::unordered_map<char, card_color_t> char_to_color;
-extern const std::unordered_map<card_value_t, std::string> value_to_string;
-extern const std::unordered_map<std::string, card_value_t> string_to_value;
-
-
-
-
-enum class Position {
+// Text of card values, colors and positions as used in protocol messages,
+// indexed by the enum's integer value.
+constexpr std::string_view value_text[] = {"", "", "2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "A"};
+constexpr char color_text[] = {'?', 'C', 'S', 'D', 'H'};
+constexpr char position_text[] = {'N', 'E', 'S', 'W'};
+
+// The other way round: the index of every character in one of the tables
+// above, or missing for characters that are not in it. Only one-character
+// values are in the table for values; "10" is told apart by the caller.
+template<typename Text, size_t N>
+constexpr std::array<int8_t, 256> make_char_table(const Text (&text)[N], size_t first, int8_t missing) {
+    std::array<int8_t, 256> table{};
+    table.fill(missing);
+    for (size_t i = first; i < N; i++) {
+        if constexpr (std::is_same_v<Text, char>) {
+            table[static_cast<unsigned char>(text[i])] = static_cast<int8_t>(i);
+        } else if (text[i].size() == 1) {
+            table[static_cast<unsigned char>(text[i][0])] = static_cast<int8_t>(i);
+        }
+    }
+    return table;
+}
+
+constexpr auto value_of_char = make_char_table(value_text, 2, 0);
+constexpr auto color_of_char = make_char_table(color_text, 1, 0);
+constexpr auto position_of_char = make_char_table(position_text, 0, -1);
+
+enum class Position : uint8_t {
     N,
     E,
     S,
     W,
 };
 
-extern const std::unordered_map<char, Position> char_to_position;
-extern const std::unordered_map<Position, char> position_to_char;
-
+// NONE if c is not a color.
+constexpr card_color_t char_to_color(char c) {
+    return static_cast<card_color_t>(color_of_char[static_cast<unsigned char>(c)]);
+}
+
+// NONE if s is not a card value.
+constexpr card_value_t string_to_value(std::string_view s) {
+    if (s == value_text[static_cast<int>(card_value_t::TEN)]) {
+        return card_value_t::TEN;
+    }
+    return s.size() == 1 ? static_cast<card_value_t>(value_of_char[static_cast<unsigned char>(s[0])])
+                         : card_value_t::NONE;
+}
+
+// -1 if c is not a position.
+constexpr int char_to_position_no(char c) {
+    return position_of_char[static_cast<unsigned char>(c)];
+}
+
+static_assert([] {
+    for (int color = 1; color < static_cast<int>(std::size(color_text)); color++) {
+        if (char_to_color(color_text[color]) != static_cast<card_color_t>(color)) {
+            return false;
+        }
+    }
+    for (int value = static_cast<int>(card_value_t::TWO); value <= static_cast<int>(card_value_t::A); value++) {
+        if (string_to_value(value_text[value]) != static_cast<card_value_t>(value)) {
+            return false;
+        }
+    }
+    for (int position = 0; position < NO_OF_PLAYERS; position++) {
+        if (char_to_position_no(position_text[position]) != position) {
+            return false;
+        }
+    }
+    return char_to_color('N') == card_color_t::NONE && char_to_color('?') == card_color_t::NONE &&
+           string_to_value("1") == card_value_t::NONE && string_to_value("0") == card_value_t::NONE &&
+           string_to_value("") == card_value_t::NONE && char_to_position_no('C') == -1 &&
+           char_to_position_no('\0') == -1;
+}(), "encoding tables have to round-trip");
+
+// A card packed into one byte: the color in the high four bits, the value
+// in the low four, so comparing the bytes orders cards by color, then value.
 class Card {
-    card_color_t color;
-    card_value_t value;
+    uint8_t code;
 
 public:
-    Card(card_color_t c, card_value_t v);
-    Card(int color, int value);
-    bool operator <(const Card& other) const;
-    bool operator ==(const Card& other) const;
-    [[nodiscard]] card_color_t get_color() const;
-    [[nodiscard]] card_value_t get_value() const;
-    [[nodiscard]] int num_value() const;
+    constexpr Card() : code(0) {}
+    constexpr Card(card_color_t c, card_value_t v) : Card(static_cast<int>(c), static_cast<int>(v)) {}
+    constexpr Card(int color, int value) : code(static_cast<uint8_t>(color << 4 | value)) {}
+    constexpr bool operator <(const Card& other) const { return this->code < other.code; }
+    constexpr bool operator ==(const Card& other) const { return this->code == other.code; }
+    [[nodiscard]] constexpr card_color_t get_color() const { return static_cast<card_color_t>(this->code >> 4); }
+    [[nodiscard]] constexpr card_value_t get_value() const { return static_cast<card_value_t>(this->code & 0xF); }
+    [[nodiscard]] constexpr int num_value() const { return this->code & 0xF; }
     void print_card() const;
 };
 
+static_assert(sizeof(Card) == 1);
+static_assert(Card(card_color_t::C, card_value_t::A) < Card(card_color_t::S, card_value_t::TWO) &&
+              Card(card_color_t::H, card_value_t::TEN) < Card(card_color_t::H, card_value_t::J) &&
+              Card(card_color_t::D, card_value_t::Q).get_color() == card_color_t::D &&
+              Card(card_color_t::D, card_value_t::Q).get_value() == card_value_t::Q &&
+              Card().get_color() == card_color_t::NONE);
 
+#define CARDS_PER_COLOR 13
+#define CARDS_IN_DECK 52
+#define MAX_TRICKS_PER_ROUND 13
 
-class Trick {
-    int no_played_cards;
+// A set of cards kept as a 52-bit mask, 13 bits per color.
+// Bits go in the order of Card::operator<, so iterating over a CardSet
+// gives its cards sorted, just like iterating over a std::set<Card>.
+class CardSet {
+    uint64_t mask;
+
+public:
+    class iterator {
+        uint64_t rest;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Card;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Card*;
+        using reference = Card;
+
+        iterator();
+        explicit iterator(uint64_t rest);
+        Card operator*() const;
+        iterator& operator++();
+        iterator operator++(int);
+        bool operator==(const iterator& other) const;
+    };
+
+    CardSet();
+    explicit CardSet(uint64_t mask);
+    [[nodiscard]] static uint64_t bit_of(Card c);
+    [[nodiscard]] static uint64_t color_bits(card_color_t c);
+
+    void insert(Card c);
+    void erase(Card c);
+    [[nodiscard]] bool contains(Card c) const;
+    [[nodiscard]] int size() const;
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] uint64_t get_mask() const;
+    [[nodiscard]] CardSet of_color(card_color_t c) const;
+    [[nodiscard]] bool has_color(card_color_t c) const;
+    [[nodiscard]] Card highest() const;
+    [[nodiscard]] Card lowest() const;
+    [[nodiscard]] Card highest_of_color(card_color_t c) const;
+    [[nodiscard]] Card highest_below(Card c) const;
+    [[nodiscard]] CardSet legal_moves(card_color_t leading_color) const;
+    [[nodiscard]] iterator begin() const;
+    [[nodiscard]] iterator end() const;
+    bool operator==(const CardSet& other) const;
+};
+
+
+
+int card_index(Card c);
+
+int card_points(int round_type, Card c);
+
+// The cards of a finished trick, as needed to score it.
+struct TrickCards {
+    int round_type;
     int trick_number;
+    CardSet cards;
+};
+
+int evaluate_trick_cards(const TrickCards& t);
+
+void evaluate_tricks(std::span<const TrickCards> tricks, std::span<int> scores);
+
+// Kept inline, with no heap storage, so copying a trick is copying 12 bytes.
+class Trick {
+    Card played_cards[NO_OF_PLAYERS];
     Card taking_card;
     Position starting_player;
     Position current_player;
     Position taking_player;
     card_color_t leading_color;
-    std::vector<Card> played_cards;
-    int round_type;
+    int8_t no_played_cards;
+    int8_t trick_number;
+    int8_t round_type;
 
 public:
+    Trick();
     Trick(Position starting_player, int trick_number, int round_type);
     [[nodiscard]] Position get_starting_player() const;
     [[nodiscard]] Position get_current_player() const;
@@ -105,7 +238,7 @@ public:
     [[nodiscard]] card_color_t get_leading_color() const;
     void add_card(Card c);
     int evaluate_trick();
-    std::vector<Card>& get_played_cards();
+    [[nodiscard]] std::span<const Card> get_played_cards() const;
     [[nodiscard]] int get_trick_number() const;
     [[nodiscard]] int get_round_type() const;
 };
@@ -113,30 +246,89 @@ public:
 class Round {
     int round_type;
     Position starting_player;
-    int finished_tricks_by_now;
+    int finished_tricks_by_now; // number of tricks in played_tricks
     int dealt_points;
-    std::string starting_hands[4];
-    std::vector<Trick> played_tricks;
+    std::string_view starting_hands[4]; // point into the deal file or the table's HandText
+    Trick played_tricks[MAX_TRICKS_PER_ROUND];
     int scores[4];
 
 public:
-    Round(int round_type, Position starting_player, std::string starting_cards[4]);
+    Round(int round_type, Position starting_player, const std::string_view starting_cards[4]);
     [[nodiscard]] Position get_starting_player() const;
     [[nodiscard]] int get_round_type() const;
     [[nodiscard]] int get_finished_tricks_by_now() const;
     [[nodiscard]] int get_dealt_points() const;
     void add_points(int p, Position pos);
-    [[nodiscard]] std::string get_starting_hand(Position pos) const;
-    std::vector<Trick>& get_played_tricks();
+    [[nodiscard]] std::string_view get_starting_hand(Position pos) const;
+    [[nodiscard]] std::span<const Trick> get_played_tricks() const;
     int get_score(int i) const;
     void add_trick(const Trick& t);
 };
 
-Position get_start_pos_from_sett(std::string& s);
+// Contents of a TRICK message: the trick number and the cards listed
+// after it (the cards already on the table, or the card a client plays).
+struct TrickMessage {
+    int trick_number;
+    int no_cards;
+    Card cards[NO_OF_PLAYERS - 1];
+};
+
+// Contents of a TAKEN message.
+struct TakenMessage {
+    int trick_number;
+    Card cards[NO_OF_PLAYERS];
+    Position taking_player;
+};
+
+// Seats listed in BUSY, bit i set for the seat of Position i.
+struct BusyMessage {
+    unsigned seats;
+};
+
+struct DealMessage {
+    int round_type;
+    Position starting_player;
+    CardSet hand;
+};
+
+struct WrongMessage {
+    int trick_number;
+};
+
+// Contents of SCORE or TOTAL, indexed by Position.
+struct ScoreMessage {
+    int scores[NO_OF_PLAYERS];
+};
+
+enum class ServerMessageType {
+    BUSY,
+    DEAL,
+    TRICK,
+    WRONG,
+    TAKEN,
+    SCORE,
+    TOTAL,
+    UNKNOWN,
+};
+
+// Any message a server sends, decoded. Only the member for type is set.
+struct ServerMessage {
+    ServerMessageType type;
+    BusyMessage busy;
+    DealMessage deal;
+    TrickMessage trick;
+    WrongMessage wrong;
+    TakenMessage taken;
+    ScoreMessage score;
+};
+
+bool parse_card(std::string_view s, size_t& i, Card& c);
+
+bool parse_trick_message(std::string_view s, TrickMessage& m);
 
-std::set<Card> create_card_set_from_string(const std::string& s);
+bool parse_taken_message(std::string_view s, TakenMessage& m);
 
-std::vector<Card> create_card_vector_from_string(const std::string& s);
+bool parse_server_message(std::string_view s, ServerMessage& m);
 
 
 
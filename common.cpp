@@ -6,18 +6,20 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <string>
-#include <regex>
 #include <sys/socket.h>
 #include <string_view>
 #include <thread>
 #include <iostream>
-#include <unordered_map>
 #include <algorithm>
 #include <functional>
-#include <iomanip>
+#include <ctime>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include "err.h"
 #include "cards.h"
 #include "common.h"
+#include "player.h"
 
 
 
@@ -32,39 +34,15 @@ uint16_t read_port(char const *string) {
 }
 
 
-void set_timeout(int socket_fd, int timeout) {
-    struct timeval tv{};
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        syserr("setsockopt failed");
-    }
-}
-
-void unset_timeout(int socket_fd) {
-    struct timeval tv{};
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        syserr("setsockopt failed");
-    }
-}
-
-
+// Accepts exactly "IAM[NESW]\r\n".
 bool check_IAM_message(const char *buffer, ssize_t length_read) {
     if (length_read != 6) {
         return false;
     }
-    std::regex IAM_regex("IAM[NESW]\r\n");
-    std::string mess{};
-    mess.assign(buffer, length_read);
-    return std::regex_match(mess, IAM_regex);
+    std::string_view mess(buffer, length_read);
+    return mess.starts_with("IAM") && mess.ends_with("\r\n") && char_to_position_no(mess[3]) >= 0;
 }
 
-// Returns 0 if the message is not a correct prefix
-// Returns 1 if the message is a correct prefix
-// Returns 2 if the message is a correct TRICK mess,age
-
 
 // Write n bytes to a descriptor.
 ssize_t writen(int fd, const void *vptr, size_t n) {
@@ -74,7 +52,6 @@ ssize_t writen(int fd, const void *vptr, size_t n) {
     nleft = n;
     while (nleft > 0) {
         if ((nwritten = write(fd, ptr, nleft)) <= 0) {
-           std::cout << "nwritten: " << nwritten << std::endl;
             return nwritten;  // error
         }
         nleft -= nwritten;
@@ -102,13 +79,6 @@ ssize_t readn(int fd, void *vptr, size_t n) {
     return n - nleft;         // return >= 0
 }
 
-int get_round_type_from_sett(std::string &s) {
-    size_t length = s.size();
-    std::string round_type = s.substr(0, length - 1);
-    return std::stoi(round_type);
-}
-
-
 std::string get_cmd_option(char ** begin, char ** end, const std::string& option)
 {
     char ** itr = std::find(begin, end, option);
@@ -141,119 +111,282 @@ std::string conditional_get_cmd_option(char ** begin, char ** end, const std::fu
 }
 
 
-std::string getFormattedTimestamp() {
-    using namespace std::chrono;
+MessageBuilder::MessageBuilder() : data{}, length(0) {}
 
-    auto now = system_clock::now();
+MessageBuilder &MessageBuilder::append(std::string_view s) {
+    size_t n = std::min(s.size(), MAX_MESSAGE_SIZE - this->length);
+    memcpy(this->data + this->length, s.data(), n);
+    this->length += n;
+    return *this;
+}
 
-    auto now_time_t = system_clock::to_time_t(now);
+MessageBuilder &MessageBuilder::append(char c) {
+    if (this->length < MAX_MESSAGE_SIZE) {
+        this->data[this->length++] = c;
+    }
+    return *this;
+}
 
-    auto now_ms = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
+MessageBuilder &MessageBuilder::append(int value) {
+    auto result = std::to_chars(this->data + this->length, this->data + MAX_MESSAGE_SIZE, value);
+    if (result.ec == std::errc()) {
+        this->length = result.ptr - this->data;
+    }
+    return *this;
+}
 
-    std::tm now_tm = *std::gmtime(&now_time_t);
+MessageBuilder &MessageBuilder::append(Card c) {
+    this->append(value_text[static_cast<int>(c.get_value())]);
+    return this->append(color_text[static_cast<int>(c.get_color())]);
+}
+
+MessageBuilder &MessageBuilder::append(Position p) {
+    return this->append(position_text[static_cast<int>(p)]);
+}
+
+MessageBuilder &MessageBuilder::end_line() {
+    return this->append(std::string_view("\r\n"));
+}
+
+void MessageBuilder::clear() {
+    this->length = 0;
+}
+
+std::string_view MessageBuilder::view() const {
+    return {this->data, this->length};
+}
 
-    std::ostringstream oss;
-    oss << std::put_time(&now_tm, "%Y-%m-%dT%H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
 
-    return oss.str();
+static void write_digits(char *out, int value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// Writes the current UTC time as "YYYY-MM-DDTHH:MM:SS.mmm" (TIMESTAMP_LENGTH
+// characters, no terminating zero) and returns the number of characters.
+// The date and time up to seconds are formatted once per second per thread
+// and cached; every other call only patches in the milliseconds.
+size_t format_timestamp(char *out) {
+    thread_local time_t cached_second = -1;
+    thread_local char cached[TIMESTAMP_LENGTH];
+
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec != cached_second) {
+        struct tm now_tm{};
+        gmtime_r(&now.tv_sec, &now_tm);
+        write_digits(cached, now_tm.tm_year + 1900, 4);
+        cached[4] = '-';
+        write_digits(cached + 5, now_tm.tm_mon + 1, 2);
+        cached[7] = '-';
+        write_digits(cached + 8, now_tm.tm_mday, 2);
+        cached[10] = 'T';
+        write_digits(cached + 11, now_tm.tm_hour, 2);
+        cached[13] = ':';
+        write_digits(cached + 14, now_tm.tm_min, 2);
+        cached[16] = ':';
+        write_digits(cached + 17, now_tm.tm_sec, 2);
+        cached[19] = '.';
+        cached_second = now.tv_sec;
+    }
+    memcpy(out, cached, TIMESTAMP_LENGTH - 3);
+    write_digits(out + TIMESTAMP_LENGTH - 3, static_cast<int>(now.tv_nsec / 1000000), 3);
+    return TIMESTAMP_LENGTH;
 }
 
 
+// Appends to a log record, silently cutting whatever does not fit.
+class RecordWriter {
+    char* data;
+    size_t capacity;
+    size_t length;
+public:
+    RecordWriter(char* data, size_t capacity) : data(data), capacity(capacity), length(0) {}
+
+    void append(std::string_view s) {
+        size_t n = std::min(s.size(), this->capacity - this->length);
+        memcpy(this->data + this->length, s.data(), n);
+        this->length += n;
+    }
+
+    void append_timestamp() {
+        if (this->capacity - this->length < TIMESTAMP_LENGTH) {
+            char timestamp[TIMESTAMP_LENGTH];
+            this->append(std::string_view(timestamp, format_timestamp(timestamp)));
+            return;
+        }
+        this->length += format_timestamp(this->data + this->length);
+    }
+
+    void append(int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof digits, value);
+        this->append(std::string_view(digits, result.ptr - digits));
+    }
+
+    [[nodiscard]] size_t get_length() const {
+        return this->length;
+    }
+};
 
-ReportPrinter::ReportPrinter() {
-    std::thread t(&ReportPrinter::printing_thread, this);
-    t.detach();
+
+ReportPrinter::ReportPrinter(LogFullPolicy policy, size_t capacity) :
+        mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1), policy(policy),
+        enqueue_pos(0), dequeue_pos(0), dropped(0), printer_waiting(false), wakeups(0), stopping(false) {
+    this->records = std::make_unique<LogRecord[]>(this->mask + 1);
+    for (size_t i = 0; i <= this->mask; i++) {
+        this->records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    this->printer = std::thread(&ReportPrinter::printing_thread, this);
 }
 
-void ReportPrinter::add_report_log_to_client(const std::string &message, Player &p) {
-    std::string log = "[";
-    log += p.get_server_interface_ip();
-    log += ":";
-    log += std::to_string(p.get_server_port());
-    log += ",";
-    log += p.get_client_ip();
-    log += ":";
-    log += std::to_string(p.get_client_port());
-    log += ",";
-    log += getFormattedTimestamp();
-    log += "] ";
-    log += message;
-    add_message(log);
+// Prints all messages added so far before returning.
+ReportPrinter::~ReportPrinter() {
+    this->stopping.store(true);
+    this->wakeups.fetch_add(1);
+    this->wakeups.notify_one();
+    this->printer.join();
 }
 
-void ReportPrinter::add_report_log_from_client(const std::string &message, Player &p) {
+uint64_t ReportPrinter::get_dropped() const {
+    return this->dropped.load(std::memory_order_relaxed);
+}
 
-    std::string log = "[";
-    log += p.get_client_ip();
-    log += ":";
-    log += std::to_string(p.get_client_port());
-    log += ",";
-    log += p.get_server_interface_ip();
-    log += ":";
-    log += std::to_string(p.get_server_port());
-    log += ",";
-    log += getFormattedTimestamp();
-    log += "] ";
-    log += message;
-    add_message(log);
+// Takes the next free slot of the ring (a bounded MPMC queue by D. Vyukov,
+// used with one consumer). Returns nullptr if the ring is full and the
+// policy is to drop messages.
+LogRecord *ReportPrinter::claim(size_t &pos) {
+    pos = this->enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        LogRecord *record = &this->records[pos & this->mask];
+        size_t sequence = record->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (this->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return record;
+            }
+        } else if (diff < 0) {
+            // the ring is full
+            if (this->policy == LogFullPolicy::DROP) {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::this_thread::yield();
+            pos = this->enqueue_pos.load(std::memory_order_relaxed);
+        } else {
+            pos = this->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
 }
 
-void ReportPrinter::add_report_log_to_client(const std::string &message, const std::string& server_ip, int server_port,
-                                               const std::string& client_ip, int client_port) {
-    std::string log = "[";
-    log += server_ip;
-    log += ":";
-    log += std::to_string(server_port);
-    log += ",";
-    log += client_ip;
-    log += ":";
-    log += std::to_string(client_port);
-    log += ",";
-    log += getFormattedTimestamp();
-    log += "] ";
-    log += message;
-    add_message(log);
-}
-
-void ReportPrinter::add_report_log_from_client(const std::string &message, const std::string& server_ip, int server_port,
-                                                 const std::string& client_ip, int client_port) {
-    std::string log = "[";
-    log += client_ip;
-    log += ":";
-    log += std::to_string(client_port);
-    log += ",";
-    log += server_ip;
-    log += ":";
-    log += std::to_string(server_port);
-    log += ",";
-    log += getFormattedTimestamp();
-    log += "] ";
-    log += message;
-    add_message(log);
+void ReportPrinter::publish(LogRecord *record, size_t pos) {
+    record->sequence.store(pos + 1, std::memory_order_release);
+    // Pairs with the fence in wait_for_records(): either the printing thread
+    // sees the record, or we see that it is going to sleep and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->printer_waiting.load(std::memory_order_relaxed)) {
+        this->wakeups.fetch_add(1);
+        this->wakeups.notify_one();
+    }
 }
 
+bool ReportPrinter::has_record() const {
+    const LogRecord &record = this->records[this->dequeue_pos & this->mask];
+    return record.sequence.load(std::memory_order_acquire) == this->dequeue_pos + 1;
+}
 
+void ReportPrinter::wait_for_records() {
+    uint32_t seen = this->wakeups.load();
+    this->printer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!this->has_record() && !this->stopping.load()) {
+        this->wakeups.wait(seen);
+    }
+    this->printer_waiting.store(false, std::memory_order_relaxed);
+}
 
- void ReportPrinter::printing_thread() {
+void ReportPrinter::printing_thread() {
+    auto batch = std::make_unique<char[]>(LOG_BATCH_SIZE);
+    uint64_t reported_dropped = 0;
     while (true) {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        if (messages.empty()) {
-            not_empty.wait(lock);
+        size_t length = 0;
+        while (length + LOG_RECORD_SIZE <= LOG_BATCH_SIZE && this->has_record()) {
+            LogRecord &record = this->records[this->dequeue_pos & this->mask];
+            memcpy(batch.get() + length, record.data, record.length);
+            length += record.length;
+            record.sequence.store(this->dequeue_pos + this->mask + 1, std::memory_order_release);
+            this->dequeue_pos++;
         }
-        if (messages.empty()) {
-            continue;
+        if (length > 0) {
+            writen(STDOUT_FILENO, batch.get(), length);
+        }
+        uint64_t now_dropped = this->get_dropped();
+        if (now_dropped != reported_dropped) {
+            std::cerr << "Report: " << now_dropped - reported_dropped << " messages dropped" << std::endl;
+            reported_dropped = now_dropped;
+        }
+        if (length == 0) {
+            if (this->stopping.load() && !this->has_record()) {
+                return;
+            }
+            this->wait_for_records();
         }
-        std::string message = messages.front();
-        messages.pop();
-        lock.unlock();
-        std::cout << message;
     }
 }
 
-void ReportPrinter::add_message(const std::string &message) {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        messages.emplace(message);
+void ReportPrinter::add_message(std::string_view message) {
+    size_t pos;
+    LogRecord *record = this->claim(pos);
+    if (record == nullptr) {
+        return;
+    }
+    RecordWriter writer(record->data, LOG_RECORD_SIZE);
+    writer.append(message);
+    record->length = writer.get_length();
+    this->publish(record, pos);
+}
+
+// Formats "[from_ip:from_port,to_ip:to_port,timestamp] message" into the ring.
+void ReportPrinter::add_log(std::string_view message, const std::string &from_ip, int from_port,
+                            const std::string &to_ip, int to_port) {
+    size_t pos;
+    LogRecord *record = this->claim(pos);
+    if (record == nullptr) {
+        return;
     }
-    not_empty.notify_all();
+    RecordWriter writer(record->data, LOG_RECORD_SIZE);
+    writer.append("[");
+    writer.append(from_ip);
+    writer.append(":");
+    writer.append(from_port);
+    writer.append(",");
+    writer.append(to_ip);
+    writer.append(":");
+    writer.append(to_port);
+    writer.append(",");
+    writer.append_timestamp();
+    writer.append("] ");
+    writer.append(message);
+    record->length = writer.get_length();
+    this->publish(record, pos);
+}
+
+void ReportPrinter::add_report_log_to_client(std::string_view message, Player &p) {
+    this->add_log(message, p.get_server_interface_ip(), p.get_server_port(), p.get_client_ip(), p.get_client_port());
+}
+
+void ReportPrinter::add_report_log_from_client(std::string_view message, Player &p) {
+    this->add_log(message, p.get_client_ip(), p.get_client_port(), p.get_server_interface_ip(), p.get_server_port());
+}
+
+void ReportPrinter::add_report_log_to_client(std::string_view message, const std::string& server_ip, int server_port,
+                                               const std::string& client_ip, int client_port) {
+    this->add_log(message, server_ip, server_port, client_ip, client_port);
+}
+
+void ReportPrinter::add_report_log_from_client(std::string_view message, const std::string& server_ip, int server_port,
+                                                 const std::string& client_ip, int client_port) {
+    this->add_log(message, client_ip, client_port, server_ip, server_port);
 }
@@ -11,27 +11,40 @@
 #include <condition_variable>
 #include <netinet/in.h>
 #include <vector>
-#include <queue>
-#include <unordered_map>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <thread>
 #include "cards.h"
-#include "player.h"
 
 
 
 #define QUEUE_LENGTH 5
-#define NO_OF_PLAYERS 4
 #define MAX_HAND_SIZE 13
 #define MAX_MESSAGE_SIZE 128
 #define DEFAULT_TIMEOUT 5
 
+class Player;
 
-extern const std::unordered_map<int, char>  position_no_to_char;
-extern const std::unordered_map<int, char>  char_to_position_no;
+// Builds one protocol message in place, without touching the heap.
+// Anything that does not fit in MAX_MESSAGE_SIZE is cut off.
+class MessageBuilder {
+    char data[MAX_MESSAGE_SIZE];
+    size_t length;
+public:
+    MessageBuilder();
+    MessageBuilder& append(std::string_view s);
+    MessageBuilder& append(char c);
+    MessageBuilder& append(int value);
+    MessageBuilder& append(Card c);
+    MessageBuilder& append(Position p);
+    MessageBuilder& end_line();
+    void clear();
+    [[nodiscard]] std::string_view view() const;
+};
 
 
 bool check_IAM_message(const char* buffer, ssize_t length_read);
-int check_TRICK_from_client(const char* buffer, ssize_t length_read);
 
 uint16_t read_port(char const *string);
 
@@ -39,12 +52,12 @@ ssize_t readn(int fd, void *vptr, size_t n);
 
 ssize_t writen(int fd, const void *vptr, size_t n);
 
-void set_timeout(int socket_fd, uint32_t timeout);
 
 
 
+#define TIMESTAMP_LENGTH 23
 
-int get_round_type_from_sett(std::string& s);
+size_t format_timestamp(char* out);
 
 std::string get_cmd_option(char ** begin, char ** end, const std::string& option);
 
@@ -54,20 +67,61 @@ bool conditional_cmd_option_exists(char** begin, char** end, const std::function
 
 std::string conditional_get_cmd_option(char ** begin, char ** end, const std::function<bool(const std::string&)> &condition);
 
+#define LOG_RECORD_SIZE 320
+#define DEFAULT_LOG_CAPACITY 4096
+#define LOG_BATCH_SIZE (64 * 1024)
+
+// What add_message does when the printing thread cannot keep up
+// and the ring is full.
+enum class LogFullPolicy {
+    BLOCK, // wait for a free slot
+    DROP,  // lose the message, counted in get_dropped()
+};
+
+// One slot of the ring. The line is formatted straight into data by the
+// thread that logs it; sequence tells whose turn it is to use the slot.
+struct LogRecord {
+    std::atomic<size_t> sequence;
+    size_t length;
+    char data[LOG_RECORD_SIZE];
+};
+
+// Writes the report to standard output from its own thread.
+// Any number of threads log through a bounded lock-free ring
+// (multi-producer, single-consumer); the printing thread drains it in
+// batches and writes each batch with a single write().
 class ReportPrinter {
-    std::mutex queue_mutex;
-    std::queue<std::string> messages;
-    std::condition_variable not_empty;
+    std::unique_ptr<LogRecord[]> records;
+    size_t mask; // capacity - 1, capacity is a power of two
+    LogFullPolicy policy;
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) size_t dequeue_pos; // only used by the printing thread
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> printer_waiting;
+    std::atomic<uint32_t> wakeups;
+    std::atomic<bool> stopping;
+    std::thread printer;
+
+    LogRecord* claim(size_t& pos);
+    void publish(LogRecord* record, size_t pos);
+    [[nodiscard]] bool has_record() const;
+    void wait_for_records();
+    void printing_thread();
+    void add_log(std::string_view message, const std::string& from_ip, int from_port,
+                 const std::string& to_ip, int to_port);
 public:
-    ReportPrinter();
-    [[noreturn]]  void printing_thread();
-    void add_message(const std::string& message);
-    void add_report_log_to_client(const std::string& message, Player& p);
-    void add_report_log_from_client(const std::string& message, Player& p);
-    void add_report_log_to_client(const std::string& message, const std::string& server_ip, int server_port,
+    explicit ReportPrinter(LogFullPolicy policy = LogFullPolicy::BLOCK, size_t capacity = DEFAULT_LOG_CAPACITY);
+    ~ReportPrinter();
+    ReportPrinter(const ReportPrinter&) = delete;
+    ReportPrinter& operator=(const ReportPrinter&) = delete;
+    void add_message(std::string_view message);
+    void add_report_log_to_client(std::string_view message, Player& p);
+    void add_report_log_from_client(std::string_view message, Player& p);
+    void add_report_log_to_client(std::string_view message, const std::string& server_ip, int server_port,
                                     const std::string& client_ip, int client_port);
-    void add_report_log_from_client(const std::string& message, const std::string& server_ip, int server_port,
+    void add_report_log_from_client(std::string_view message, const std::string& server_ip, int server_port,
                                       const std::string& client_ip, int client_port);
+    [[nodiscard]] uint64_t get_dropped() const;
 };
 
 
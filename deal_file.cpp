@@ -0,0 +1,511 @@
+//
+// Created by jan on 17/06/24.
+//
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "deal_file.h"
+#include "err.h"
+
+
+// Fills deal from text. Returns false and sets error if the round is not
+// a valid one: round type 1-7, a starting player, 13 cards for every player
+// and every card of the deck dealt exactly once.
+bool parse_deal(const DealText &text, Deal &deal, const char *&error) {
+    if (text.settings.size() != 2 || text.settings[0] < '1' ||
+        text.settings[0] > '0' + NO_OF_ROUND_TYPES) {
+        error = "bad round type";
+        return false;
+    }
+    deal.round_type = text.settings[0] - '0';
+    int starting_player = char_to_position_no(text.settings[1]);
+    if (starting_player < 0) {
+        error = "bad starting player";
+        return false;
+    }
+    deal.starting_player = static_cast<Position>(starting_player);
+    CardSet dealt;
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        std::string_view hand = text.hands[i];
+        deal.hands[i] = CardSet();
+        size_t j = 0;
+        int no_cards = 0;
+        while (j < hand.size()) {
+            Card c;
+            if (!parse_card(hand, j, c)) {
+                error = "bad card";
+                return false;
+            }
+            if (deal.hands[i].contains(c) || ++no_cards > MAX_TRICKS_PER_ROUND) {
+                error = "a hand does not have 13 different cards";
+                return false;
+            }
+            deal.hands[i].insert(c);
+        }
+        if (no_cards != MAX_TRICKS_PER_ROUND) {
+            error = "a hand does not have 13 different cards";
+            return false;
+        }
+        if ((dealt.get_mask() & deal.hands[i].get_mask()) != 0) {
+            error = "a card is dealt twice";
+            return false;
+        }
+        dealt = CardSet(dealt.get_mask() | deal.hands[i].get_mask());
+    }
+    return true;
+}
+
+// The ids of the cards must be a permutation of the deck.
+bool check_record(const DealRecord &record, const char *&error) {
+    if (record.round_type < 1 || record.round_type > NO_OF_ROUND_TYPES) {
+        error = "bad round type";
+        return false;
+    }
+    if (record.starting_player >= NO_OF_PLAYERS) {
+        error = "bad starting player";
+        return false;
+    }
+    uint64_t dealt = 0;
+    for (uint8_t id: record.cards) {
+        if (id >= CARDS_IN_DECK) {
+            error = "bad card";
+            return false;
+        }
+        dealt |= uint64_t{1} << id;
+    }
+    if (dealt != (uint64_t{1} << CARDS_IN_DECK) - 1) {
+        error = "a card is dealt twice";
+        return false;
+    }
+    return true;
+}
+
+void record_to_deal(const DealRecord &record, Deal &deal) {
+    deal.round_type = record.round_type;
+    deal.starting_player = static_cast<Position>(record.starting_player);
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        uint64_t mask = 0;
+        for (int j = 0; j < MAX_TRICKS_PER_ROUND; j++) {
+            mask |= uint64_t{1} << record.cards[i * MAX_TRICKS_PER_ROUND + j];
+        }
+        deal.hands[i] = CardSet(mask);
+    }
+}
+
+// Text of every card, by card_index(), padded to four bytes so that it can
+// be copied with one fixed-size store.
+struct CardText {
+    char text[4];
+    uint8_t length;
+};
+
+static constexpr auto card_text = [] {
+    std::array<CardText, CARDS_IN_DECK> table{};
+    for (int id = 0; id < CARDS_IN_DECK; id++) {
+        std::string_view value = value_text[id % CARDS_PER_COLOR + static_cast<int>(card_value_t::TWO)];
+        for (size_t i = 0; i < value.size(); i++) {
+            table[id].text[i] = value[i];
+        }
+        table[id].text[value.size()] = color_text[id / CARDS_PER_COLOR + 1];
+        table[id].length = value.size() + 1;
+    }
+    return table;
+}();
+
+// Writes the cards of one player, as in a DEAL message, to out
+// (at least MAX_HAND_TEXT bytes). Returns the length of the text.
+size_t write_hand_text(const DealRecord &record, int player, char *out) {
+    size_t length = 0;
+    for (int j = 0; j < MAX_TRICKS_PER_ROUND; j++) {
+        const CardText &card = card_text[record.cards[player * MAX_TRICKS_PER_ROUND + j]];
+        memcpy(out + length, card.text, sizeof(card.text));
+        length += card.length;
+    }
+    return length;
+}
+
+static uint64_t load_le(const char *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = value << 8 | static_cast<uint8_t>(p[i]);
+    }
+    return value;
+}
+
+static void store_le(char *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t fnv1a(uint64_t hash, const char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ static_cast<uint8_t>(p[i])) * FNV_PRIME;
+    }
+    return hash;
+}
+
+
+DealFile::DealFile(const std::string &filename, uint32_t threads) : filename(filename), data(nullptr), size(0),
+                                                                    format(DealFormat::TEXT), no_of_rounds(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        syserr("Could not open file %s", filename.c_str());
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) < 0) {
+        syserr("fstat");
+    }
+    this->size = file_stat.st_size;
+    if (this->size > 0) {
+        void *mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            syserr("mmap");
+        }
+        this->data = static_cast<const char *>(mapping);
+    }
+    close(fd);
+    threads = std::max<uint32_t>(1, threads);
+    if (this->size >= strlen(BINARY_DEAL_MAGIC) &&
+        memcmp(this->data, BINARY_DEAL_MAGIC, strlen(BINARY_DEAL_MAGIC)) == 0) {
+        this->format = DealFormat::BINARY;
+        this->read_header();
+    } else {
+        this->build_index(threads);
+        this->no_of_rounds = this->round_offsets.size();
+    }
+    this->validate(threads);
+}
+
+DealFile::~DealFile() {
+    if (this->data != nullptr) {
+        munmap(const_cast<char *>(this->data), this->size);
+    }
+}
+
+DealFormat DealFile::get_format() const {
+    return this->format;
+}
+
+size_t DealFile::get_no_of_rounds() const {
+    return this->no_of_rounds;
+}
+
+// Checks that the header of a binary file matches its size and, if the file
+// has a checksum, that the records are not damaged.
+void DealFile::read_header() {
+    if (this->size < BINARY_DEAL_HEADER_SIZE) {
+        fatal("File %s: binary header is truncated", this->filename.c_str());
+    }
+    uint64_t version = load_le(this->data + 4, 2);
+    if (version != BINARY_DEAL_VERSION) {
+        fatal("File %s: unsupported binary format version %" PRIu64, this->filename.c_str(), version);
+    }
+    uint64_t flags = load_le(this->data + 6, 2);
+    uint64_t rounds = load_le(this->data + 8, 8);
+    size_t records_size = this->size - BINARY_DEAL_HEADER_SIZE;
+    if (records_size % sizeof(DealRecord) != 0 || records_size / sizeof(DealRecord) != rounds) {
+        fatal("File %s: header says %" PRIu64 " rounds, but the file holds %zu bytes of rounds",
+              this->filename.c_str(), rounds, records_size);
+    }
+    this->no_of_rounds = rounds;
+    if (flags & BINARY_DEAL_HAS_CHECKSUM) {
+        uint64_t hash = fnv1a(FNV_OFFSET_BASIS, this->data + BINARY_DEAL_HEADER_SIZE, records_size);
+        if (hash != load_le(this->data + 16, 8)) {
+            fatal("File %s: checksum does not match", this->filename.c_str());
+        }
+    }
+}
+
+// Finds where every round starts. The file is cut into one chunk per thread:
+// first every thread counts the lines in its chunk, then, knowing how many
+// lines come before its chunk, it records the lines that begin a round.
+void DealFile::build_index(uint32_t threads) {
+    if (this->size == 0) {
+        return;
+    }
+    size_t chunks = std::min<size_t>(threads, std::max<size_t>(1, this->size / (1 << 20)));
+    std::vector<size_t> chunk_start(chunks + 1);
+    for (size_t c = 0; c <= chunks; c++) {
+        chunk_start[c] = this->size / chunks * c;
+    }
+    chunk_start[chunks] = this->size;
+
+    std::vector<uint64_t> newlines(chunks, 0);
+    std::vector<std::vector<uint64_t>> offsets(chunks);
+    auto run_parallel = [chunks](const std::function<void(size_t)> &work) {
+        std::vector<std::thread> workers;
+        for (size_t c = 1; c < chunks; c++) {
+            workers.emplace_back(work, c);
+        }
+        work(0);
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    };
+    run_parallel([&](size_t c) {
+        newlines[c] = std::count(this->data + chunk_start[c], this->data + chunk_start[c + 1], '\n');
+    });
+    run_parallel([&](size_t c) {
+        uint64_t line = 0;
+        for (size_t i = 0; i < c; i++) {
+            line += newlines[i];
+        }
+        const char *end = this->data + chunk_start[c + 1];
+        const char *p = this->data + chunk_start[c];
+        if (c == 0) {
+            offsets[c].push_back(0);
+        }
+        while ((p = static_cast<const char *>(memchr(p, '\n', end - p))) != nullptr) {
+            p++;
+            line++;
+            if (line % LINES_PER_ROUND == 0 && p != this->data + this->size) {
+                offsets[c].push_back(p - this->data);
+            }
+        }
+    });
+
+    uint64_t lines = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        lines += newlines[c];
+        this->round_offsets.insert(this->round_offsets.end(), offsets[c].begin(), offsets[c].end());
+    }
+    if (this->data[this->size - 1] != '\n') {
+        lines++; // the last line has no newline
+    }
+    if (lines % LINES_PER_ROUND != 0) {
+        fatal("File %s ends with an incomplete round", this->filename.c_str());
+    }
+}
+
+// Checks every round, spread over the threads. Stops the server
+// if any round is not valid.
+void DealFile::validate(uint32_t threads) const {
+    size_t rounds = this->no_of_rounds;
+    size_t workers_count = std::min<size_t>(threads, std::max<size_t>(1, rounds / 4096));
+    std::vector<size_t> first_bad(workers_count, rounds);
+    std::vector<const char *> errors(workers_count, nullptr);
+    auto work = [&](size_t w) {
+        for (size_t i = rounds * w / workers_count; i < rounds * (w + 1) / workers_count; i++) {
+            if (!this->check_round(i, errors[w])) {
+                first_bad[w] = i;
+                return;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < workers_count; w++) {
+        workers.emplace_back(work, w);
+    }
+    work(0);
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    for (size_t w = 0; w < workers_count; w++) {
+        if (first_bad[w] == rounds) {
+            continue;
+        }
+        if (this->format == DealFormat::BINARY) {
+            fatal("File %s, round %zu: %s", this->filename.c_str(), first_bad[w] + 1, errors[w]);
+        }
+        fatal("File %s, round %zu (line %zu): %s", this->filename.c_str(), first_bad[w] + 1,
+              first_bad[w] * LINES_PER_ROUND + 1, errors[w]);
+    }
+}
+
+bool DealFile::check_round(size_t index, const char *&error) const {
+    if (this->format == DealFormat::BINARY) {
+        return check_record(*this->record_at(index), error);
+    }
+    Deal deal{};
+    return parse_deal(this->get_round(index), deal, error);
+}
+
+// Returns the line starting at offset, without the line ending,
+// and moves offset to the next line.
+std::string_view DealFile::line_at(size_t &offset) const {
+    const char *start = this->data + offset;
+    const char *newline = static_cast<const char *>(memchr(start, '\n', this->size - offset));
+    size_t length = newline != nullptr ? newline - start : this->size - offset;
+    offset += newline != nullptr ? length + 1 : length;
+    if (length > 0 && start[length - 1] == '\r') {
+        length--;
+    }
+    return {start, length};
+}
+
+DealText DealFile::get_round(size_t index) const {
+    size_t offset = this->round_offsets[index];
+    DealText text;
+    text.settings = this->line_at(offset);
+    for (auto &hand: text.hands) {
+        hand = this->line_at(offset);
+    }
+    return text;
+}
+
+const DealRecord *DealFile::record_at(size_t index) const {
+    return reinterpret_cast<const DealRecord *>(this->data + BINARY_DEAL_HEADER_SIZE + index * sizeof(DealRecord));
+}
+
+// Reads the round to be played and the text of its hands.
+void DealFile::get_deal(size_t index, Deal &deal, HandText &text) const {
+    if (this->format == DealFormat::BINARY) {
+        const DealRecord *record = this->record_at(index);
+        record_to_deal(*record, deal);
+        for (int i = 0; i < NO_OF_PLAYERS; i++) {
+            text.hands[i] = {text.buffer[i], write_hand_text(*record, i, text.buffer[i])};
+        }
+        return;
+    }
+    DealText round = this->get_round(index);
+    const char *error;
+    if (!parse_deal(round, deal, error)) {
+        fatal("Round %zu changed since the deal file was checked: %s", index + 1, error);
+    }
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        text.hands[i] = round.hands[i];
+    }
+}
+
+// Reads a round as a binary record, keeping the order of the cards.
+void DealFile::get_record(size_t index, DealRecord &record) const {
+    if (this->format == DealFormat::BINARY) {
+        memcpy(&record, this->record_at(index), sizeof(DealRecord));
+        return;
+    }
+    DealText round = this->get_round(index);
+    Deal deal{};
+    const char *error;
+    if (!parse_deal(round, deal, error)) {
+        fatal("Round %zu changed since the deal file was checked: %s", index + 1, error);
+    }
+    record.round_type = deal.round_type;
+    record.starting_player = static_cast<uint8_t>(deal.starting_player);
+    int k = 0;
+    for (auto hand: round.hands) {
+        size_t j = 0;
+        Card c;
+        int hand_end = k + MAX_TRICKS_PER_ROUND;
+        while (parse_card(hand, j, c)) {
+            if (k == hand_end) {
+                fatal("Round %zu changed since the deal file was checked: a hand has more than 13 cards", index + 1);
+            }
+            record.cards[k++] = card_index(c);
+        }
+        if (k != hand_end) {
+            fatal("Round %zu changed since the deal file was checked: a hand has fewer than 13 cards", index + 1);
+        }
+    }
+}
+
+
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+static void write_all(int fd, const char *data, size_t size, const std::string &filename) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0 && errno != EINTR) {
+            syserr("write to %s", filename.c_str());
+        }
+        if (n > 0) {
+            written += n;
+        }
+    }
+}
+
+// Appends one round to out, as a record or as five lines of text.
+void append_record(std::vector<char> &out, DealFormat format, const DealRecord &record) {
+    if (format == DealFormat::BINARY) {
+        const char *bytes = reinterpret_cast<const char *>(&record);
+        out.insert(out.end(), bytes, bytes + sizeof(DealRecord));
+        return;
+    }
+    size_t start = out.size();
+    out.resize(start + 3 + NO_OF_PLAYERS * (MAX_HAND_TEXT + 1));
+    char *p = out.data() + start;
+    *p++ = static_cast<char>('0' + record.round_type);
+    *p++ = position_text[record.starting_player];
+    *p++ = '\n';
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        p += write_hand_text(record, i, p);
+        *p++ = '\n';
+    }
+    out.resize(p - out.data());
+}
+
+DealWriter::DealWriter(const std::string &filename, DealFormat format, bool checksum)
+        : filename(filename), format(format), checksum(checksum), rounds(0), hash(FNV_OFFSET_BASIS) {
+    this->fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0) {
+        syserr("Could not open file %s", filename.c_str());
+    }
+    this->buffer.reserve(WRITE_BUFFER_SIZE + CARDS_IN_DECK * 4);
+    if (format == DealFormat::BINARY) {
+        this->buffer.resize(BINARY_DEAL_HEADER_SIZE, 0); // filled in by finish()
+    }
+}
+
+DealWriter::~DealWriter() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+void DealWriter::flush() {
+    write_all(this->fd, this->buffer.data(), this->buffer.size(), this->filename);
+    this->buffer.clear();
+}
+
+void DealWriter::add(const DealRecord &record) {
+    append_record(this->buffer, this->format, record);
+    if (this->format == DealFormat::BINARY && this->checksum) {
+        this->hash = fnv1a(this->hash, reinterpret_cast<const char *>(&record), sizeof(DealRecord));
+    }
+    this->rounds++;
+    if (this->buffer.size() >= WRITE_BUFFER_SIZE) {
+        this->flush();
+    }
+}
+
+// Adds block_rounds rounds formatted with append_record() in this writer's format.
+void DealWriter::add_block(const std::vector<char> &block, uint64_t block_rounds) {
+    this->flush();
+    if (this->format == DealFormat::BINARY && this->checksum) {
+        this->hash = fnv1a(this->hash, block.data(), block.size());
+    }
+    write_all(this->fd, block.data(), block.size(), this->filename);
+    this->rounds += block_rounds;
+}
+
+// Writes what is left in the buffer and, for a binary file, the header.
+void DealWriter::finish() {
+    this->flush();
+    if (this->format == DealFormat::BINARY) {
+        char header[BINARY_DEAL_HEADER_SIZE];
+        memcpy(header, BINARY_DEAL_MAGIC, strlen(BINARY_DEAL_MAGIC));
+        store_le(header + 4, BINARY_DEAL_VERSION, 2);
+        store_le(header + 6, this->checksum ? BINARY_DEAL_HAS_CHECKSUM : 0, 2);
+        store_le(header + 8, this->rounds, 8);
+        store_le(header + 16, this->checksum ? this->hash : 0, 8);
+        if (pwrite(this->fd, header, sizeof(header), 0) != sizeof(header)) {
+            syserr("write to %s", this->filename.c_str());
+        }
+    }
+    if (close(this->fd) < 0) {
+        syserr("close %s", this->filename.c_str());
+    }
+    this->fd = -1;
+}
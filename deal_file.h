@@ -0,0 +1,132 @@
+//
+// Created by jan on 17/06/24.
+//
+
+#ifndef KIERKI_DEAL_FILE_H
+#define KIERKI_DEAL_FILE_H
+
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cards.h"
+#include "game.h"
+
+#define LINES_PER_ROUND 5
+
+// Binary deal files start with a header:
+//   0: magic "KRKD"
+//   4: version, 16-bit little-endian
+//   6: flags, 16-bit little-endian
+//   8: number of rounds, 64-bit little-endian
+//  16: FNV-1a hash of all the records, 64-bit little-endian,
+//      or 0 if the file has no checksum
+// followed by one DealRecord per round.
+#define BINARY_DEAL_MAGIC "KRKD"
+#define BINARY_DEAL_VERSION 1
+#define BINARY_DEAL_HEADER_SIZE 24
+#define BINARY_DEAL_HAS_CHECKSUM 1
+
+// Enough for the text of any 13 cards (at most 30 bytes) and the padding
+// write_hand_text() stores past its end.
+#define MAX_HAND_TEXT 40
+
+enum class DealFormat {
+    TEXT,
+    BINARY,
+};
+
+// One round as written in a deal file: "<round type><starting player>"
+// followed by the cards of N, E, S and W, each on its own line.
+struct DealText {
+    std::string_view settings;
+    std::string_view hands[NO_OF_PLAYERS];
+};
+
+// One round of a binary deal file: the round type, the starting player
+// (0-3 for N, E, S, W) and the card_index() of all 52 cards, 13 for N,
+// then E, S and W, every hand in the order it is sent to the player.
+struct DealRecord {
+    uint8_t round_type;
+    uint8_t starting_player;
+    uint8_t cards[CARDS_IN_DECK];
+};
+
+static_assert(sizeof(DealRecord) == 2 + CARDS_IN_DECK);
+
+// Cards of every hand, as sent in DEAL. For a text file the views point
+// into the mapping, for a binary file into buffer.
+struct HandText {
+    std::string_view hands[NO_OF_PLAYERS];
+    char buffer[NO_OF_PLAYERS][MAX_HAND_TEXT];
+};
+
+// A deal file mapped into memory, in either format. Every round is found and checked when the
+// file is opened, so a bad file is rejected before any game starts; after
+// that rounds are read straight from the mapping, without copying.
+// The object is read-only once constructed and may be shared between threads.
+class DealFile {
+    std::string filename;
+    const char* data;
+    size_t size;
+    DealFormat format;
+    std::vector<uint64_t> round_offsets; // text files only
+    size_t no_of_rounds;
+
+    void build_index(uint32_t threads);
+    void read_header();
+    void validate(uint32_t threads) const;
+    [[nodiscard]] bool check_round(size_t index, const char*& error) const;
+    [[nodiscard]] std::string_view line_at(size_t& offset) const;
+    [[nodiscard]] const DealRecord* record_at(size_t index) const;
+    [[nodiscard]] DealText get_round(size_t index) const;
+
+public:
+    explicit DealFile(const std::string& filename, uint32_t threads = 1);
+    ~DealFile();
+    DealFile(const DealFile&) = delete;
+    DealFile& operator=(const DealFile&) = delete;
+
+    [[nodiscard]] DealFormat get_format() const;
+    [[nodiscard]] size_t get_no_of_rounds() const;
+    void get_deal(size_t index, Deal& deal, HandText& text) const;
+    void get_record(size_t index, DealRecord& record) const;
+};
+
+// Writes deal files, in large blocks. Rounds are added one by one, or as
+// blocks already formatted with append_record(). The header of a binary file
+// is written by finish(), once the number of rounds and the checksum are known.
+class DealWriter {
+    std::string filename;
+    int fd;
+    DealFormat format;
+    bool checksum;
+    uint64_t rounds;
+    uint64_t hash;
+    std::vector<char> buffer;
+
+    void flush();
+
+public:
+    DealWriter(const std::string& filename, DealFormat format, bool checksum = true);
+    ~DealWriter();
+    DealWriter(const DealWriter&) = delete;
+    DealWriter& operator=(const DealWriter&) = delete;
+
+    void add(const DealRecord& record);
+    void add_block(const std::vector<char>& block, uint64_t block_rounds);
+    void finish();
+};
+
+void append_record(std::vector<char>& out, DealFormat format, const DealRecord& record);
+
+bool parse_deal(const DealText& text, Deal& deal, const char*& error);
+
+bool check_record(const DealRecord& record, const char*& error);
+
+void record_to_deal(const DealRecord& record, Deal& deal);
+
+size_t write_hand_text(const DealRecord& record, int player, char* out);
+
+
+#endif //KIERKI_DEAL_FILE_H
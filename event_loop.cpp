@@ -0,0 +1,288 @@
+//
+// Created by jan on 12/06/24.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "err.h"
+
+
+EventLoop::EventLoop() : stopped(false), next_timer_id(1), wheel_start(loop_clock::now()), current_tick(0),
+                         occupied{} {
+    for (auto &level: this->wheel) {
+        for (auto &slot: level) {
+            slot.prev = &slot;
+            slot.next = &slot;
+        }
+    }
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+        syserr("epoll_create1");
+    }
+    this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->wake_fd < 0) {
+        syserr("eventfd");
+    }
+    this->add_fd(this->wake_fd, EPOLLIN, [this](uint32_t) { this->run_posted(); });
+}
+
+EventLoop::~EventLoop() {
+    close(this->wake_fd);
+    close(this->epoll_fd);
+}
+
+void EventLoop::add_fd(int fd, uint32_t events, fd_handler handler) {
+    struct epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        syserr("epoll_ctl add");
+    }
+    this->handlers[fd] = std::move(handler);
+}
+
+void EventLoop::modify_fd(int fd, uint32_t events) {
+    struct epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        syserr("epoll_ctl mod");
+    }
+}
+
+// Must be called before the descriptor is closed.
+void EventLoop::remove_fd(int fd) {
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    this->handlers.erase(fd);
+}
+
+// Whole ticks from the start of the wheel to t, rounded up, so that
+// a timer never fires before its deadline.
+uint64_t EventLoop::ticks_until(loop_clock::time_point t) const {
+    auto ticks = std::chrono::ceil<std::chrono::milliseconds>(t - this->wheel_start).count();
+    return static_cast<uint64_t>(std::max<int64_t>(ticks, 0));
+}
+
+// Puts the timer in the slot for its expiry: on level 0 if it expires within
+// 256 ticks, on level 1 within 256^2 ticks and so on. A timer further away
+// than the top level reaches waits in its last slot and is sorted again
+// when the wheel gets there.
+void EventLoop::insert_timer(Timer &timer) {
+    uint64_t delta = timer.expires - this->current_tick;
+    uint64_t expires = timer.expires;
+    if (delta >> (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS) != 0) {
+        delta = (uint64_t{1} << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+        expires = this->current_tick + delta;
+    }
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >> ((level + 1) * TIMER_WHEEL_BITS) != 0) {
+        level++;
+    }
+    int slot = static_cast<int>((expires >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1));
+    TimerLink &head = this->wheel[level][slot];
+    timer.level = level;
+    timer.slot = slot;
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    this->occupied[level][slot / 64] |= uint64_t{1} << (slot % 64);
+}
+
+void EventLoop::unlink_timer(Timer &timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    TimerLink &head = this->wheel[timer.level][timer.slot];
+    if (head.next == &head) {
+        this->occupied[timer.level][timer.slot / 64] &= ~(uint64_t{1} << (timer.slot % 64));
+    }
+}
+
+// Moves all timers of the slot to list, an empty list head.
+void EventLoop::take_slot(int level, int slot, TimerLink &list) {
+    TimerLink &head = this->wheel[level][slot];
+    this->occupied[level][slot / 64] &= ~(uint64_t{1} << (slot % 64));
+    if (head.next == &head) {
+        list.prev = &list;
+        list.next = &list;
+        return;
+    }
+    list.next = head.next;
+    list.prev = head.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head.prev = &head;
+    head.next = &head;
+}
+
+// Sorts the timers of the level's current slot into the levels below.
+void EventLoop::cascade(int level) {
+    int slot = static_cast<int>((this->current_tick >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1));
+    TimerLink list{};
+    this->take_slot(level, slot, list);
+    while (list.next != &list) {
+        auto *timer = static_cast<Timer *>(list.next);
+        list.next = timer->next;
+        timer->next->prev = &list;
+        this->insert_timer(*timer);
+    }
+}
+
+EventLoop::timer_id EventLoop::add_timer(loop_clock::duration delay, timer_handler handler) {
+    timer_id id = this->next_timer_id++;
+    Timer &timer = this->timers[id];
+    timer.id = id;
+    timer.expires = std::max(this->ticks_until(loop_clock::now() + delay), this->current_tick + 1);
+    timer.handler = std::move(handler);
+    this->insert_timer(timer);
+    return id;
+}
+
+// Cancelling a timer that already fired (or was never armed) is a no-op.
+void EventLoop::cancel_timer(timer_id id) {
+    auto it = this->timers.find(id);
+    if (it == this->timers.end()) {
+        return;
+    }
+    this->unlink_timer(it->second);
+    this->timers.erase(it);
+}
+
+// Schedules task to be run on the loop's thread. Safe to call from any thread.
+void EventLoop::post(std::function<void()> task) {
+    {
+        std::unique_lock<std::mutex> lock(this->posted_mutex);
+        this->posted.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    if (write(this->wake_fd, &one, sizeof one) < 0 && errno != EAGAIN) {
+        syserr("eventfd write");
+    }
+}
+
+void EventLoop::run_posted() {
+    uint64_t count;
+    if (read(this->wake_fd, &count, sizeof count) < 0 && errno != EAGAIN) {
+        syserr("eventfd read");
+    }
+    std::vector<std::function<void()>> tasks;
+    {
+        std::unique_lock<std::mutex> lock(this->posted_mutex);
+        tasks.swap(this->posted);
+    }
+    for (auto &task: tasks) {
+        task();
+    }
+}
+
+// A tick no timer fires before: the exact expiry of the first timer on
+// level 0, or the tick on which the wheel reaches the first used slot
+// of a higher level.
+uint64_t EventLoop::next_expiry_bound() const {
+    uint64_t bound = UINT64_MAX;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        const uint64_t *bits = this->occupied[level];
+        if (std::all_of(bits, bits + TIMER_WHEEL_WORDS, [](uint64_t word) { return word == 0; })) {
+            continue;
+        }
+        int shift = level * TIMER_WHEEL_BITS;
+        uint64_t position = this->current_tick >> shift;
+        for (uint64_t i = 1; i <= TIMER_WHEEL_SLOTS; i++) {
+            uint64_t slot = (position + i) & (TIMER_WHEEL_SLOTS - 1);
+            if (bits[slot / 64] & (uint64_t{1} << (slot % 64))) {
+                bound = std::min(bound, (position + i) << shift);
+                break;
+            }
+        }
+    }
+    return bound;
+}
+
+int EventLoop::next_timeout_ms() const {
+    if (this->timers.empty()) {
+        return -1;
+    }
+    uint64_t bound = this->next_expiry_bound();
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(loop_clock::now() - this->wheel_start).count();
+    if (static_cast<int64_t>(bound) <= now) {
+        return 0;
+    }
+    return static_cast<int>(std::min<uint64_t>(bound - now, INT32_MAX));
+}
+
+// Turns the wheel tick by tick up to now, running the timers of every tick.
+void EventLoop::run_expired_timers() {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(loop_clock::now() - this->wheel_start).count();
+    auto target = static_cast<uint64_t>(now);
+    while (this->current_tick < target) {
+        if (this->timers.empty()) {
+            this->current_tick = target; // nothing to cascade
+            break;
+        }
+        this->current_tick++;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((this->current_tick & ((uint64_t{1} << (level * TIMER_WHEEL_BITS)) - 1)) != 0) {
+                break;
+            }
+            this->cascade(level);
+        }
+        TimerLink expired{};
+        this->take_slot(0, static_cast<int>(this->current_tick & (TIMER_WHEEL_SLOTS - 1)), expired);
+        while (expired.next != &expired) {
+            auto *timer = static_cast<Timer *>(expired.next);
+            // the handler may cancel timers still on this list, so it stays a proper list
+            expired.next = timer->next;
+            timer->next->prev = &expired;
+            timer_handler handler = std::move(timer->handler);
+            this->timers.erase(timer->id);
+            handler();
+        }
+    }
+}
+
+void EventLoop::run_once() {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int ready = epoll_wait(this->epoll_fd, events, MAX_EPOLL_EVENTS, this->next_timeout_ms());
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        syserr("epoll_wait");
+    }
+    for (int i = 0; i < ready; i++) {
+        auto it = this->handlers.find(events[i].data.fd);
+        if (it == this->handlers.end()) {
+            continue; // descriptor was removed by an earlier handler in this batch
+        }
+        // The handler may remove itself, so we call a copy.
+        fd_handler handler = it->second;
+        handler(events[i].events);
+    }
+    this->run_expired_timers();
+}
+
+void EventLoop::run() {
+    while (!this->stopped) {
+        this->run_once();
+    }
+}
+
+void EventLoop::stop() {
+    this->stopped = true;
+}
+
+bool EventLoop::is_stopped() const {
+    return this->stopped;
+}
+
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        syserr("fcntl");
+    }
+}
@@ -0,0 +1,106 @@
+//
+// Created by jan on 12/06/24.
+//
+
+#ifndef KIERKI_EVENT_LOOP_H
+#define KIERKI_EVENT_LOOP_H
+
+#include <chrono>
+#include <cinttypes>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+#define MAX_EPOLL_EVENTS 64
+
+// The timer wheel counts time in ticks of one millisecond. Every level has
+// 256 slots, each covering 256 times more ticks than a slot of the level
+// below, so four levels reach 2^32 ms (about 49 days) ahead.
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_WORDS ((TIMER_WHEEL_SLOTS + 63) / 64)
+
+using loop_clock = std::chrono::steady_clock;
+
+// Single-threaded reactor built on epoll.
+// Every descriptor has exactly one handler, called with the epoll event mask
+// whenever the descriptor is ready. Timers are one-shot and run on the same
+// thread as the descriptor handlers, so handlers never need locking.
+// post() is the only method that may be called from other threads.
+//
+// Timers live in a hierarchical timer wheel: adding and cancelling one is
+// O(1), whatever the number of timers. A timer waits in a slot of the level
+// that matches how far away it is, and moves down a level each time the
+// wheel reaches its slot, until it fires from the lowest level on its tick.
+class EventLoop {
+public:
+    using fd_handler = std::function<void(uint32_t)>;
+    using timer_handler = std::function<void()>;
+    using timer_id = uint64_t;
+
+private:
+    int epoll_fd;
+    bool stopped;
+    timer_id next_timer_id;
+    std::unordered_map<int, fd_handler> handlers;
+
+    // Timers of one slot form a circular list, headed by the slot itself.
+    struct TimerLink {
+        TimerLink* prev;
+        TimerLink* next;
+    };
+    struct Timer : TimerLink {
+        timer_id id;
+        uint64_t expires; // tick on which the timer fires
+        int level;
+        int slot;
+        timer_handler handler;
+    };
+
+    loop_clock::time_point wheel_start; // time of tick 0
+    uint64_t current_tick; // the last tick whose timers have been run
+    TimerLink wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_WORDS]; // bit set if the slot has timers
+    std::unordered_map<timer_id, Timer> timers; // nodes do not move, so the lists may point into them
+
+    int wake_fd; // eventfd signalled by post()
+    std::mutex posted_mutex;
+    std::vector<std::function<void()>> posted;
+
+    [[nodiscard]] uint64_t ticks_until(loop_clock::time_point t) const;
+    void insert_timer(Timer& timer);
+    void unlink_timer(Timer& timer);
+    void take_slot(int level, int slot, TimerLink& list);
+    void cascade(int level);
+    [[nodiscard]] uint64_t next_expiry_bound() const;
+    [[nodiscard]] int next_timeout_ms() const;
+    void run_expired_timers();
+    void run_posted();
+
+public:
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void add_fd(int fd, uint32_t events, fd_handler handler);
+    void modify_fd(int fd, uint32_t events);
+    void remove_fd(int fd);
+
+    timer_id add_timer(loop_clock::duration delay, timer_handler handler);
+    void cancel_timer(timer_id id);
+
+    void post(std::function<void()> task);
+
+    void run_once();
+    void run();
+    void stop();
+    [[nodiscard]] bool is_stopped() const;
+};
+
+void set_nonblocking(int fd);
+
+
+#endif //KIERKI_EVENT_LOOP_H
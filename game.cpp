@@ -0,0 +1,90 @@
+//
+// Created by jan on 14/06/24.
+//
+
+#include "game.h"
+
+
+Game::Game() : round_type(0), round_points(0), round_scores{0, 0, 0, 0}, total_scores{0, 0, 0, 0} {}
+
+// Deals the cards and starts the first trick. Total scores are kept.
+void Game::start_round(const Deal &deal) {
+    this->round_type = deal.round_type;
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        this->hands[i] = deal.hands[i];
+        this->round_scores[i] = 0;
+    }
+    this->round_points = 0;
+    this->trick.emplace(deal.starting_player, 1, deal.round_type);
+}
+
+// Plays c for the player to move. Returns false and changes nothing
+// if the move is not legal for them.
+bool Game::play(Card c) {
+    if (!this->in_round() || this->is_trick_complete()) {
+        return false;
+    }
+    Position player = this->trick->get_current_player();
+    if (!this->legal_moves(player).contains(c)) {
+        return false;
+    }
+    this->hands[static_cast<int>(player)].erase(c);
+    this->trick->add_card(c);
+    if (this->is_trick_complete()) {
+        int points = this->trick->evaluate_trick();
+        int taker = static_cast<int>(this->trick->get_taking_player());
+        this->round_scores[taker] += points;
+        this->total_scores[taker] += points;
+        this->round_points += points;
+    }
+    return true;
+}
+
+// Should be called only if the trick is complete and the round is not over.
+void Game::next_trick() {
+    this->trick.emplace(this->trick->get_taking_player(), this->trick->get_trick_number() + 1, this->round_type);
+}
+
+bool Game::in_round() const {
+    return this->trick.has_value();
+}
+
+bool Game::is_trick_complete() const {
+    return this->trick->get_no_played_cards() == NO_OF_PLAYERS;
+}
+
+// The round ends early once all of its points have been dealt.
+bool Game::is_round_over() const {
+    return this->is_trick_complete() &&
+           (this->round_points == max_points_per_round[this->round_type] ||
+            this->trick->get_trick_number() == MAX_TRICKS_PER_ROUND);
+}
+
+int Game::get_round_type() const {
+    return this->round_type;
+}
+
+const Trick &Game::get_trick() const {
+    return *this->trick;
+}
+
+Position Game::get_current_player() const {
+    return this->trick->get_current_player();
+}
+
+CardSet Game::get_hand(Position p) const {
+    return this->hands[static_cast<int>(p)];
+}
+
+CardSet Game::legal_moves(Position p) const {
+    card_color_t leading_color = this->in_round() ? this->trick->get_leading_color() : card_color_t::NONE;
+    return this->hands[static_cast<int>(p)].legal_moves(leading_color);
+}
+
+const int *Game::get_round_scores() const {
+    return this->round_scores;
+}
+
+const int *Game::get_total_scores() const {
+    return this->total_scores;
+}
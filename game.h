@@ -0,0 +1,53 @@
+//
+// Created by jan on 14/06/24.
+//
+
+#ifndef KIERKI_GAME_H
+#define KIERKI_GAME_H
+
+#include <optional>
+#include "cards.h"
+
+
+// Starting position of one round: its type, the player leading the first
+// trick and the cards of every player.
+struct Deal {
+    int round_type;
+    Position starting_player;
+    CardSet hands[NO_OF_PLAYERS];
+};
+
+// The rules of the game, without any I/O.
+// A round begins with start_round(), after which cards are played one by one
+// with play(). The fourth card of a trick resolves it and scores it for the
+// taker. Then either the round is over, or next_trick() starts the next trick,
+// led by the player who took the last one.
+class Game {
+    int round_type;
+    CardSet hands[NO_OF_PLAYERS];
+    std::optional<Trick> trick;
+    int round_points; // points dealt in the current round so far
+    int round_scores[NO_OF_PLAYERS];
+    int total_scores[NO_OF_PLAYERS];
+
+public:
+    Game();
+
+    void start_round(const Deal& deal);
+    bool play(Card c);
+    void next_trick();
+
+    [[nodiscard]] bool in_round() const;
+    [[nodiscard]] bool is_trick_complete() const;
+    [[nodiscard]] bool is_round_over() const;
+    [[nodiscard]] int get_round_type() const;
+    [[nodiscard]] const Trick& get_trick() const;
+    [[nodiscard]] Position get_current_player() const;
+    [[nodiscard]] CardSet get_hand(Position p) const;
+    [[nodiscard]] CardSet legal_moves(Position p) const;
+    [[nodiscard]] const int* get_round_scores() const;
+    [[nodiscard]] const int* get_total_scores() const;
+};
+
+
+#endif //KIERKI_GAME_H
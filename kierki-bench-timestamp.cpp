@@ -0,0 +1,70 @@
+//
+// Created by jan on 19/06/24.
+//
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "common.h"
+
+// Cost of the timestamp of one report line: the ostringstream and put_time
+// formatting the report used to do for every line, against format_timestamp()
+// writing straight into a LogRecord.
+
+#define ITERATIONS 2000000
+
+// The formatting done for every line before format_timestamp().
+static std::string old_timestamp() {
+    using namespace std::chrono;
+    auto now = system_clock::now();
+    auto now_time_t = system_clock::to_time_t(now);
+    auto now_ms = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
+    std::tm now_tm = *std::gmtime(&now_time_t);
+    std::ostringstream oss;
+    oss << std::put_time(&now_tm, "%Y-%m-%dT%H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
+    return oss.str();
+}
+
+// Runs write_line ITERATIONS times and returns the nanoseconds per call.
+template<typename F>
+static double measure(F write_line) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        write_line();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+int main() {
+    LogRecord record{};
+    size_t checksum = 0;
+
+    double old_ns = measure([&] {
+        std::string timestamp = old_timestamp();
+        memcpy(record.data, timestamp.data(), timestamp.size());
+        record.length = timestamp.size();
+        checksum += static_cast<unsigned char>(record.data[TIMESTAMP_LENGTH - 1]);
+    });
+    std::string old_text(record.data, record.length);
+
+    double new_ns = measure([&] {
+        record.length = format_timestamp(record.data);
+        checksum += static_cast<unsigned char>(record.data[TIMESTAMP_LENGTH - 1]);
+    });
+    std::string new_text(record.data, record.length);
+
+    std::cout << "ostringstream + put_time: " << std::fixed << std::setprecision(1) << old_ns << " ns/line ("
+              << old_text << ")\n";
+    std::cout << "format_timestamp:         " << new_ns << " ns/line (" << new_text << ")\n";
+    std::cout << "speedup: " << old_ns / new_ns << "x (checksum " << checksum << ")\n";
+    if (old_text.size() != new_text.size() || old_text.compare(0, 10, new_text, 0, 10) != 0) {
+        std::cerr << "Error: the two timestamps differ in format.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+//
+// Created by jan on 17/06/24.
+//
+
+#include <iostream>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "kierki-convert.h"
+
+
+namespace po = boost::program_options;
+
+Convert_Options::Convert_Options() : format(DealFormat::BINARY), checksum(true) {}
+
+void Convert_Options::set_input(const std::string &i) {
+    this->input = i;
+}
+
+void Convert_Options::set_output(const std::string &o) {
+    this->output = o;
+}
+
+void Convert_Options::set_format(DealFormat f) {
+    this->format = f;
+}
+
+void Convert_Options::set_checksum(bool c) {
+    this->checksum = c;
+}
+
+const std::string &Convert_Options::get_input() const {
+    return this->input;
+}
+
+const std::string &Convert_Options::get_output() const {
+    return this->output;
+}
+
+DealFormat Convert_Options::get_format() const {
+    return this->format;
+}
+
+bool Convert_Options::get_checksum() const {
+    return this->checksum;
+}
+
+
+int get_options(Convert_Options &options, int argc, char *argv[]) {
+    try {
+        po::options_description desc("Allowed options");
+        desc.add_options()
+                ("help,h", "produce help message")
+                ("input,i", po::value<std::string>()->required(), "set deal file to read (text or binary)")
+                ("output,o", po::value<std::string>()->required(), "set deal file to write")
+                ("format,f", po::value<std::string>()->default_value("binary"), "set format of the output: text or binary")
+                ("no-checksum", "do not store a checksum in a binary file");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help")) {
+            std::cerr << desc << "\n";
+            return 1;
+        }
+        po::notify(vm);
+
+        std::string format = vm["format"].as<std::string>();
+        if (format == "text") {
+            options.set_format(DealFormat::TEXT);
+        } else if (format == "binary") {
+            options.set_format(DealFormat::BINARY);
+        } else {
+            std::cerr << "Error: unknown format " << format << ".\n";
+            return 1;
+        }
+        options.set_input(vm["input"].as<std::string>());
+        options.set_output(vm["output"].as<std::string>());
+        options.set_checksum(vm.count("no-checksum") == 0);
+    } catch (const po::error &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+// Converts a deal file between the text and the binary format. The input is
+// checked like the server checks it, and the cards of every hand keep their
+// order, so converting a file there and back gives the same file.
+int main(int argc, char *argv[]) {
+    Convert_Options options;
+    if (get_options(options, argc, argv) == 1) {
+        return 1;
+    }
+
+    DealFile deals(options.get_input(), std::max(1u, std::thread::hardware_concurrency()));
+    DealWriter writer(options.get_output(), options.get_format(), options.get_checksum());
+    DealRecord record{};
+    for (size_t i = 0; i < deals.get_no_of_rounds(); i++) {
+        deals.get_record(i, record);
+        writer.add(record);
+    }
+    writer.finish();
+    return 0;
+}
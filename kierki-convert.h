@@ -0,0 +1,30 @@
+//
+// Created by jan on 17/06/24.
+//
+
+#ifndef KIERKI_KIERKI_CONVERT_H
+#define KIERKI_KIERKI_CONVERT_H
+
+#include <string>
+#include "deal_file.h"
+
+class Convert_Options {
+    std::string input;
+    std::string output;
+    DealFormat format;
+    bool checksum;
+
+public:
+    Convert_Options();
+    void set_input(const std::string& i);
+    void set_output(const std::string& o);
+    void set_format(DealFormat f);
+    void set_checksum(bool c);
+    [[nodiscard]] const std::string& get_input() const;
+    [[nodiscard]] const std::string& get_output() const;
+    [[nodiscard]] DealFormat get_format() const;
+    [[nodiscard]] bool get_checksum() const;
+};
+
+
+#endif //KIERKI_KIERKI_CONVERT_H
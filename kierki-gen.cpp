@@ -0,0 +1,230 @@
+//
+// Created by jan on 18/06/24.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "kierki-gen.h"
+
+
+namespace po = boost::program_options;
+
+Gen_Options::Gen_Options() : rounds(0), threads(1), seed(1), format(DealFormat::TEXT), checksum(true) {}
+
+void Gen_Options::set_output(const std::string &o) {
+    this->output = o;
+}
+
+void Gen_Options::set_rounds(uint64_t r) {
+    this->rounds = r;
+}
+
+void Gen_Options::set_threads(uint32_t t) {
+    this->threads = t;
+}
+
+void Gen_Options::set_seed(uint64_t s) {
+    this->seed = s;
+}
+
+void Gen_Options::set_format(DealFormat f) {
+    this->format = f;
+}
+
+void Gen_Options::set_checksum(bool c) {
+    this->checksum = c;
+}
+
+const std::string &Gen_Options::get_output() const {
+    return this->output;
+}
+
+uint64_t Gen_Options::get_rounds() const {
+    return this->rounds;
+}
+
+uint32_t Gen_Options::get_threads() const {
+    return this->threads;
+}
+
+uint64_t Gen_Options::get_seed() const {
+    return this->seed;
+}
+
+DealFormat Gen_Options::get_format() const {
+    return this->format;
+}
+
+bool Gen_Options::get_checksum() const {
+    return this->checksum;
+}
+
+
+Xoshiro256::Xoshiro256(std::seed_seq &seed) : state{} {
+    uint32_t words[8];
+    seed.generate(words, words + 8);
+    for (int i = 0; i < 4; i++) {
+        this->state[i] = static_cast<uint64_t>(words[2 * i]) << 32 | words[2 * i + 1];
+    }
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t Xoshiro256::operator()() {
+    uint64_t result = rotl(this->state[1] * 5, 7) * 9;
+    uint64_t t = this->state[1] << 17;
+    this->state[2] ^= this->state[0];
+    this->state[3] ^= this->state[1];
+    this->state[1] ^= this->state[2];
+    this->state[0] ^= this->state[3];
+    this->state[2] ^= t;
+    this->state[3] = rotl(this->state[3], 45);
+    return result;
+}
+
+
+// A number from [0, n), by Lemire's multiply-and-shift, which needs a
+// division only in the rare case a draw has to be rejected.
+static uint64_t bounded(Xoshiro256 &rng, uint64_t n) {
+    unsigned __int128 m = static_cast<unsigned __int128>(rng()) * n;
+    auto low = static_cast<uint64_t>(m);
+    if (low < n) {
+        uint64_t threshold = -n % n;
+        while (low < threshold) {
+            m = static_cast<unsigned __int128>(rng()) * n;
+            low = static_cast<uint64_t>(m);
+        }
+    }
+    return static_cast<uint64_t>(m >> 64);
+}
+
+// Draws a round like generate.py did: any round type, any starting player
+// and a shuffled deck, dealt 13 cards at a time.
+static void generate_round(Xoshiro256 &rng, DealRecord &record) {
+    record.round_type = 1 + bounded(rng, NO_OF_ROUND_TYPES);
+    record.starting_player = bounded(rng, NO_OF_PLAYERS);
+    std::iota(record.cards, record.cards + CARDS_IN_DECK, 0);
+    for (int i = CARDS_IN_DECK - 1; i > 0; i--) {
+        std::swap(record.cards[i], record.cards[bounded(rng, i + 1)]);
+    }
+}
+
+// Chunks are handed out to the threads in order. A thread formats its chunk
+// on its own, then waits until the chunks before it are written, so the file
+// is the same for any number of threads.
+static void generate(const Gen_Options &options, DealWriter &writer) {
+    uint64_t chunks = (options.get_rounds() + ROUNDS_PER_CHUNK - 1) / ROUNDS_PER_CHUNK;
+    std::atomic<uint64_t> next_chunk{0};
+    uint64_t written_chunks = 0;
+    std::mutex mutex;
+    std::condition_variable chunk_written;
+
+    auto work = [&]() {
+        std::vector<char> block;
+        DealRecord record{};
+        uint64_t chunk;
+        while ((chunk = next_chunk++) < chunks) {
+            uint64_t first = chunk * ROUNDS_PER_CHUNK;
+            uint64_t rounds = std::min<uint64_t>(ROUNDS_PER_CHUNK, options.get_rounds() - first);
+            std::seed_seq seed{options.get_seed(), chunk};
+            Xoshiro256 rng(seed);
+            block.clear();
+            for (uint64_t i = 0; i < rounds; i++) {
+                generate_round(rng, record);
+                append_record(block, options.get_format(), record);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            chunk_written.wait(lock, [&] { return written_chunks == chunk; });
+            writer.add_block(block, rounds);
+            written_chunks++;
+            chunk_written.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < options.get_threads(); i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+int get_options(Gen_Options &options, int argc, char *argv[]) {
+    try {
+        po::options_description desc("Allowed options");
+        desc.add_options()
+                ("help,h", "produce help message")
+                ("output,o", po::value<std::string>()->required(), "set deal file to write")
+                ("rounds,r", po::value<uint64_t>()->required(), "set number of rounds to generate")
+                ("threads,j", po::value<int>()->default_value(0), "set number of threads (0 - one per core)")
+                ("seed,s", po::value<uint64_t>()->default_value(1), "set seed of the random number generators")
+                ("format,f", po::value<std::string>()->default_value("text"), "set format of the output: text or binary")
+                ("no-checksum", "do not store a checksum in a binary file");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help")) {
+            std::cerr << desc << "\n";
+            return 1;
+        }
+        po::notify(vm);
+
+        int threads = vm["threads"].as<int>();
+        if (threads < 0) {
+            std::cerr << "Error: number of threads has to be non-negative.\n";
+            return 1;
+        }
+        if (threads == 0) {
+            threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        std::string format = vm["format"].as<std::string>();
+        if (format == "text") {
+            options.set_format(DealFormat::TEXT);
+        } else if (format == "binary") {
+            options.set_format(DealFormat::BINARY);
+        } else {
+            std::cerr << "Error: unknown format " << format << ".\n";
+            return 1;
+        }
+        options.set_output(vm["output"].as<std::string>());
+        options.set_rounds(vm["rounds"].as<uint64_t>());
+        options.set_threads(threads);
+        options.set_seed(vm["seed"].as<uint64_t>());
+        options.set_checksum(vm.count("no-checksum") == 0);
+    } catch (const po::error &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    Gen_Options options;
+    if (get_options(options, argc, argv) == 1) {
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    DealWriter writer(options.get_output(), options.get_format(), options.get_checksum());
+    generate(options, writer);
+    writer.finish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "Generated " << options.get_rounds() << " rounds on " << options.get_threads() << " threads in "
+              << elapsed.count() << " s\n";
+    return 0;
+}
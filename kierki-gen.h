@@ -0,0 +1,56 @@
+//
+// Created by jan on 18/06/24.
+//
+
+#ifndef KIERKI_KIERKI_GEN_H
+#define KIERKI_KIERKI_GEN_H
+
+#include <cinttypes>
+#include <random>
+#include <string>
+#include "deal_file.h"
+
+// Rounds generated from one seed and written as one block. Every chunk has
+// its own generator, so the output only depends on the seed.
+#define ROUNDS_PER_CHUNK (1 << 16)
+
+// xoshiro256** by Blackman and Vigna: a few shifts and xors per number,
+// several times faster than std::mt19937_64, which dominated generation time.
+class Xoshiro256 {
+    uint64_t state[4];
+
+public:
+    using result_type = uint64_t;
+
+    explicit Xoshiro256(std::seed_seq& seed);
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()();
+};
+
+class Gen_Options {
+    std::string output;
+    uint64_t rounds;
+    uint32_t threads;
+    uint64_t seed;
+    DealFormat format;
+    bool checksum;
+
+public:
+    Gen_Options();
+    void set_output(const std::string& o);
+    void set_rounds(uint64_t r);
+    void set_threads(uint32_t t);
+    void set_seed(uint64_t s);
+    void set_format(DealFormat f);
+    void set_checksum(bool c);
+    [[nodiscard]] const std::string& get_output() const;
+    [[nodiscard]] uint64_t get_rounds() const;
+    [[nodiscard]] uint32_t get_threads() const;
+    [[nodiscard]] uint64_t get_seed() const;
+    [[nodiscard]] DealFormat get_format() const;
+    [[nodiscard]] bool get_checksum() const;
+};
+
+
+#endif //KIERKI_KIERKI_GEN_H
@@ -5,12 +5,14 @@
 #include <string>
 #include <boost/program_options.hpp>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <csignal>
-#include <regex>
 #include "kierki-klient.h"
 #include "err.h"
 #include "common.h"
 #include "player.h"
+#include "line_framer.h"
 
 
 namespace po = boost::program_options;
@@ -85,7 +87,7 @@ Position ClientPlayer::get_pos() const {
     return position;
 }
 
-std::set<Card> ClientPlayer::get_hand() const {
+CardSet ClientPlayer::get_hand() const {
     return hand;
 }
 
@@ -101,22 +103,19 @@ int ClientPlayer::get_current_round_type() const {
     return current_round_type;
 }
 
-void print_card_set(const std::set<Card>& s) {
-    if (s.empty()) {
-        return;
-    }
-
-    auto last = --s.end();
-    for (auto it = s.begin(); it != s.end(); ++it) {
-        it->print_card();
-        if (it != last) {
+void print_card_set(const CardSet& s) {
+    bool first = true;
+    for (Card card: s) {
+        if (!first) {
             std::cout << ", ";
         }
+        card.print_card();
+        first = false;
     }
 }
 
 
-void print_card_vector(const std::vector<Card>& v) {
+void print_card_vector(std::span<const Card> v) {
     if (v.empty()) {
         return;
     }
@@ -139,44 +138,22 @@ void ClientPlayer::remove_card(Card c) {
 }
 
 bool ClientPlayer::has_card(Card c) const {
-    return hand.find(c) != hand.end();
+    return hand.contains(c);
 }
 
 bool ClientPlayer::has_card_of_color(card_color_t c) const {
-    for (const auto &card: hand) {
-        if (card.get_color() == c) {
-            return true;
-        }
-    }
-    return false;
+    return hand.has_color(c);
 }
 
+// Returns a card with no color and value if there is no card of color c.
 Card ClientPlayer::get_biggest_of_color(card_color_t c) const {
-    if (!has_card_of_color(c)) {
-        return {card_color_t::NONE, card_value_t::NONE};
-    }
-    Card biggest(c, card_value_t::TWO);
-    for (const auto &card: hand) {
-        if (card.get_color() == c && card < biggest) {
-            biggest = card;
-        }
-    }
-    return biggest;
+    return hand.highest_of_color(c);
 }
 
+// Returns a card with no color and value if there is no smaller card
+// of the same color as c.
 Card ClientPlayer::get_biggest_smaller_than(Card c) const {
-    Card biggest(c.get_color(), card_value_t::TWO);
-    for (const auto &card: hand) {
-
-        // Cards are sorted on the  hand, so we know that
-        // if we find a card with the same color as c and
-        // smaller value than c, it is the biggest card
-        // smaller than c by now
-        if (card.get_color() == c.get_color() && card < c) {
-            biggest = card;
-        }
-    }
-    return biggest;
+    return hand.highest_below(c);
 }
 
 void ClientTrick::print_trick() const {
@@ -187,9 +164,7 @@ void ClientTrick::set_played_cards(const std::vector<Card>& c) {
     played_cards = c;
 }
 
-ClientTrick::ClientTrick(const std::vector<Card>& played_cards) {
-    this->played_cards = played_cards;
-}
+ClientTrick::ClientTrick(std::span<const Card> played_cards) : played_cards(played_cards.begin(), played_cards.end()) {}
 
 
 bool ClientPlayer::get_play_now() const {
@@ -216,10 +191,6 @@ void ClientPlayer::set_last_played_card(Card c) {
 void ClientPlayer::client_commands_thread(int sock) {
    std::cout << "Client commands thread started\n";
     std::string command;
-    std::stringstream ss;
-    ss << "!";
-    ss << card_regex_string;
-    std::string card_command_regex_str  = ss.str();
     while (true) {
         std::cin >> command;
         if (command == "cards") {
@@ -234,21 +205,23 @@ void ClientPlayer::client_commands_thread(int sock) {
                 std::cout << "\n";
             }
         }
-        if (std::regex_match(command, std::regex(card_command_regex_str))) {
+        // "!<card>", with nothing after the card
+        Card card;
+        size_t card_end = 1;
+        if (!command.empty() && command[0] == '!' && parse_card(command, card_end, card) &&
+            card_end == command.size()) {
             std::unique_lock<std::mutex> lock(cards_mutex);
-            std::string card_str = command.substr(1);
-            Card card = create_card_vector_from_string(card_str)[0];
             if (has_card(card)) {
                 set_last_played_card(card);
                 std::stringstream ss2;
                 ss2 << "TRICK";
                 ss2 << current_trick_number;
-                ss2 << value_to_string.at(card.get_value());
-                ss2 << color_to_char.at(card.get_color());
+                ss2 << value_text[card.num_value()];
+                ss2 << color_text[static_cast<int>(card.get_color())];
                 ss2 << "\r\n";
                 std::string message = ss2.str();
                 ssize_t bytes_sent = writen(sock, message.c_str(), message.size());
-                if (bytes_sent < message.size()) {
+                if (bytes_sent < static_cast<ssize_t>(message.size())) {
                     std::cerr << "Error writing to socket\n";
                     return;
                 }
@@ -370,21 +343,19 @@ int connect_to_server(const Client_Options& options) {
     return sock;
 }
 
-void print_busy_places(const std::string& message) {
+void print_busy_places(const BusyMessage& m) {
     std::cout << "Place busy, list of busy places received: ";
-    int i = 4;
-    auto message_length = message.size();
-    while (i < message_length) {
-        std::cout << message[i];
-        if (i != message_length - 1) {
-            std::cout << ", ";
+    bool first = true;
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        if ((m.seats & (1u << i)) != 0) {
+            std::cout << (first ? "" : ", ") << position_text[i];
+            first = false;
         }
-        i++;
     }
     std::cout << ".\n";
 }
 
-void ClientPlayer::set_hand(const std::set<Card>& h) {
+void ClientPlayer::set_hand(const CardSet& h) {
     hand = h;
 }
 
@@ -400,112 +371,98 @@ Card ClientPlayer::get_last_played_card() const {
     return last_played_card;
 }
 
+// Picks a card for the trick in m: plays just under the card taking the trick
+// (get_biggest_smaller_than) when it can, otherwise the least dangerous card
+// of the leading color, or the most dangerous one if it cannot follow.
+// Returns a card with no color and value if the hand is empty.
+Card ClientPlayer::choose_automatic_card(const TrickMessage &m) const {
+    if (hand.empty()) {
+        return {card_color_t::NONE, card_value_t::NONE};
+    }
+    MoveView view{current_round_type, m.trick_number, hand, std::span<const Card>(m.cards, m.no_cards)};
+    return choose_heuristic_card(view);
+}
 
 
-void print_deal_message(ClientPlayer& player, char starting_player) {
-    std::cout << "New deal " << player.get_current_round_type() << ": staring place " << starting_player << ", cards ";
+
+void print_deal_message(ClientPlayer& player, Position starting_player) {
+    std::cout << "New deal " << player.get_current_round_type() << ": staring place "
+              << position_text[static_cast<int>(starting_player)] << ", cards ";
     player.print_hand();
     std::cout << ".\n";
 
 }
 
 
-// returns 1 if server can disconnect in the next read, 0 otherwise
-void process_message(const std::string& message, ClientPlayer& player) {
-    if (message.starts_with("BUSY")) {
-        player.set_game_may_be_over(0);
-        print_busy_places(message);
-    }
-    else if (message.starts_with("DEAL")) {
-        player.set_game_may_be_over(0);
-        int round_type = message[4] - '0';
-        char starting_player = message[5];
-        std::string hand_str = message.substr(6);
-        std::set<Card> hand = create_card_set_from_string(hand_str);
-        {
-            std::unique_lock<std::mutex> lock = player.get_cards_lock();
-            player.set_hand(hand);
-            player.set_current_round_type(round_type);
-        }
-        print_deal_message(player, starting_player);
-        player.set_play_now(false);
-
-    }
-    else if (message.starts_with("WRONG")) {
-        player.set_game_may_be_over(0);
-        std::string wrong_str = message;
-        wrong_str = wrong_str.substr(5);
-        std::cout << "Wrong message received in trick " << wrong_str << ".\n";
-        std::unique_lock<std::mutex> lock = player.get_cards_lock();
-        player.set_play_now(false);
-    }
-    else if (message.starts_with("TAKEN")) {
-        player.set_game_may_be_over(0);
-        std::string taken_message = message; //TODO - WRONG
-        std::smatch match;
-        std::regex_search(taken_message, match, std::regex(taken_regex_string));
-        std::string taken_number = match[1];
-        taken_message.erase(0, 5); // TAKEN
-        taken_message.erase(0, taken_number.size());
-        size_t length = taken_message.size();
-        char position = taken_message[length - 1];
-        std::string cards_str = taken_message.substr(0, length - 1);
-        std::vector<Card> cards = create_card_vector_from_string(cards_str);
-        std::cout << "A trick " << taken_number << " is taken by " << position << ", cards ";
-        print_card_vector(cards);
-        std::cout << ".\n";
-        std::unique_lock<std::mutex> lock = player.get_cards_lock();
-        player.remove_card(player.get_last_played_card());
-        if (char_to_position.at(position) == player.get_pos()) { // we took the trick
-            ClientTrick trick(cards);
-            player.add_trick(trick);
+// Shows a message from the server to the user. message has no CRLF.
+void process_message(std::string_view message, ClientPlayer& player) {
+    ServerMessage m{};
+    parse_server_message(message, m);
+    switch (m.type) {
+        case ServerMessageType::BUSY:
+            player.set_game_may_be_over(0);
+            print_busy_places(m.busy);
+            break;
+        case ServerMessageType::DEAL: {
+            player.set_game_may_be_over(0);
+            {
+                std::unique_lock<std::mutex> lock = player.get_cards_lock();
+                player.set_hand(m.deal.hand);
+                player.set_current_round_type(m.deal.round_type);
+            }
+            print_deal_message(player, m.deal.starting_player);
+            player.set_play_now(false);
+            break;
         }
-        player.set_play_now(false);
-    }
-    else if (message.starts_with("SCORE") || message.starts_with("TOTAL")) {
-        std::string score_message = message.substr(5);
-        player.set_game_may_be_over(player.get_game_may_be_over() + 1);
-        if (message.starts_with("SCORE")) {
-            std::cout << "The scores are:\n";
+        case ServerMessageType::WRONG: {
+            player.set_game_may_be_over(0);
+            std::cout << "Wrong message received in trick " << m.wrong.trick_number << ".\n";
+            std::unique_lock<std::mutex> lock = player.get_cards_lock();
+            player.set_play_now(false);
+            break;
         }
-        else {
-            std::cout << "The total scores are:\n";
+        case ServerMessageType::TAKEN: {
+            player.set_game_may_be_over(0);
+            std::cout << "A trick " << m.taken.trick_number << " is taken by "
+                      << position_text[static_cast<int>(m.taken.taking_player)] << ", cards ";
+            print_card_vector(m.taken.cards);
+            std::cout << ".\n";
+            std::unique_lock<std::mutex> lock = player.get_cards_lock();
+            player.remove_card(player.get_last_played_card());
+            if (m.taken.taking_player == player.get_pos()) { // we took the trick
+                player.add_trick(ClientTrick(m.taken.cards));
+            }
+            player.set_play_now(false);
+            break;
         }
-        std::string positions =  "NESW";
-        for (int i = 0; i < 4; i++) {
-            std::cout << positions[i];
-            std::cout << " | ";
-            auto index = score_message.find(positions[i]);
-            index++;
-            std::stringstream ss;
-            while(index < score_message.size() && score_message[index] != 'N' && score_message[index] != 'E' && score_message[index] != 'S' && score_message[index] != 'W') {
-                ss << score_message[index];
-                index++;
+        case ServerMessageType::SCORE:
+        case ServerMessageType::TOTAL:
+            player.set_game_may_be_over(player.get_game_may_be_over() + 1);
+            if (m.type == ServerMessageType::SCORE) {
+                std::cout << "The scores are:\n";
+            } else {
+                std::cout << "The total scores are:\n";
             }
-            std::cout << ss.str() << "\n";
-
+            for (int i = 0; i < NO_OF_PLAYERS; i++) {
+                std::cout << position_text[i] << " | " << m.score.scores[i] << "\n";
+            }
+            break;
+        case ServerMessageType::TRICK: {
+            std::cout << "Trick : (" << m.trick.trick_number << ") ";
+            player.set_game_may_be_over(0);
+            print_card_vector(std::span<const Card>(m.trick.cards, m.trick.no_cards));
+            std::cout << "\n";
+            std::cout << "Available: ";
+            std::unique_lock<std::mutex> lock = player.get_cards_lock();
+            player.print_hand();
+            std::cout << "\n";
+            player.set_current_trick_number(m.trick.trick_number);
+            player.set_play_now(true);
+            break;
         }
-    }
-    else if (message.starts_with("TRICK")) {
-       std::smatch match;
-       std::regex_match(message, match, std::regex(trick_regex_string));
-       std::string trick_number = match[1];
-       std::cout << "Trick : (" << trick_number << ") ";
-        player.set_game_may_be_over(0);
-        std::string trick_message = message;
-        trick_message = trick_message.substr(5 + trick_number.size());
-        std::vector<Card> cards = create_card_vector_from_string(trick_message);
-        print_card_vector(cards);
-        std::cout << "\n";
-        std::cout << "Available: ";
-        std::unique_lock<std::mutex> lock = player.get_cards_lock();
-        player.print_hand();
-        std::cout << "\n";
-        player.set_current_trick_number(std::stoi(trick_number));
-        player.set_play_now(true);
-    }
-    else {
-        std::cerr << "Unknown message received: " << message << "\n";
+        case ServerMessageType::UNKNOWN:
+            std::cerr << "Unknown message received: " << message << "\n";
+            break;
     }
 }
 
@@ -517,19 +474,21 @@ int send_IAM(int sock, char position) {
     message += position;
     message += "\r\n";
     ssize_t bytes_sent = writen(sock, message.c_str(), message.size());
-    if (bytes_sent < message.size()) {
+    if (bytes_sent < static_cast<ssize_t>(message.size())) {
         std::cerr << "Error writing to socket\n";
         return -1;
     }
     return 0;
 }
 
-int receive_messages(int sock, ClientPlayer& player) {
-    std::vector<char> buffer(128);
-    std::string data;
+// Calls on_message for every line received, with its CRLF, until the
+// server disconnects or on_message returns -1.
+// Returns 0 if the game was over by then, -1 otherwise.
+int receive_messages(int sock, ClientPlayer& player, const std::function<int(std::string_view)>& on_message) {
+    LineFramer input;
 
     while (true) {
-        ssize_t bytes_read = read(sock, buffer.data(), buffer.size());
+        ssize_t bytes_read = input.read_from(sock);
         if (bytes_read < 0) {
             std::cerr << "Error reading from socket" << std::endl;
             return -1;
@@ -541,16 +500,19 @@ int receive_messages(int sock, ClientPlayer& player) {
             return -1;
         }
 
-        data.append(buffer.data(), bytes_read);
-
-        size_t pos;
-        while ((pos = data.find("\r\n")) != std::string::npos) {
-            std::string message = data.substr(0, pos);
-            data.erase(0, pos + 2);
-            process_message(message, player);
+        std::string_view line;
+        FrameStatus status;
+        while ((status = input.next_line(line)) == FrameStatus::LINE) {
+            if (on_message(line) < 0) {
+                return -1;
+            }
             // other thread should not alert main thread about losing connection - main will sooner or later also
             // receive the message about losing connection, and we don't want to lose information about messages
         }
+        if (status == FrameStatus::TOO_LONG) {
+            std::cerr << "Error: message from the server is too long" << std::endl;
+            return -1;
+        }
     }
 }
 
@@ -561,14 +523,129 @@ void ClientPlayer::start_client_commands_thread(int sock) {
 
 
 
+static std::string address_to_string(const struct sockaddr_storage& address, int& port) {
+    char address_str[INET6_ADDRSTRLEN] = "";
+    if (address.ss_family == AF_INET6) {
+        const auto *address6 = reinterpret_cast<const struct sockaddr_in6 *>(&address);
+        inet_ntop(AF_INET6, &address6->sin6_addr, address_str, sizeof address_str);
+        port = ntohs(address6->sin6_port);
+    } else {
+        const auto *address4 = reinterpret_cast<const struct sockaddr_in *>(&address);
+        inet_ntop(AF_INET, &address4->sin_addr, address_str, sizeof address_str);
+        port = ntohs(address4->sin_port);
+    }
+    return address_str;
+}
+
+int get_connection_addresses(int sock, ConnectionAddresses& addresses) {
+    struct sockaddr_storage address{};
+    socklen_t length = sizeof address;
+    if (getsockname(sock, (struct sockaddr *) &address, &length) < 0) {
+        return -1;
+    }
+    addresses.client_ip = address_to_string(address, addresses.client_port);
+    length = sizeof address;
+    if (getpeername(sock, (struct sockaddr *) &address, &length) < 0) {
+        return -1;
+    }
+    addresses.server_ip = address_to_string(address, addresses.server_port);
+    return 0;
+}
+
+// Sends a message in automatic mode and puts it in the report.
+int send_automatic(int sock, std::string_view message, const ConnectionAddresses& addresses, ReportPrinter& printer) {
+    ssize_t bytes_sent = writen(sock, message.data(), message.size());
+    if (bytes_sent < static_cast<ssize_t>(message.size())) {
+        std::cerr << "Error writing to socket\n";
+        return -1;
+    }
+    printer.add_report_log_from_client(message, addresses.server_ip, addresses.server_port,
+                                       addresses.client_ip, addresses.client_port);
+    return 0;
+}
+
+// Handles one message from the server without any user: a TRICK is answered
+// before anything else is done, the report is written afterwards.
+// line ends with CRLF. Returns -1 if the connection has to be closed.
+int process_automatic_message(std::string_view line, ClientPlayer& player, int sock,
+                              const ConnectionAddresses& addresses, ReportPrinter& printer) {
+    MessageBuilder answer;
+    ServerMessage m{};
+    parse_server_message(line.substr(0, line.size() - 2), m);
+    switch (m.type) {
+        case ServerMessageType::TRICK: {
+            player.set_game_may_be_over(0);
+            Card card = player.choose_automatic_card(m.trick);
+            if (card.get_color() != card_color_t::NONE) {
+                player.set_current_trick_number(m.trick.trick_number);
+                player.set_last_played_card(card);
+                answer.append("TRICK").append(m.trick.trick_number).append(card).end_line();
+                if (writen(sock, answer.view().data(), answer.view().size()) < static_cast<ssize_t>(answer.view().size())) {
+                    std::cerr << "Error writing to socket\n";
+                    return -1;
+                }
+            }
+            break;
+        }
+        case ServerMessageType::DEAL:
+            player.set_game_may_be_over(0);
+            player.set_current_round_type(m.deal.round_type);
+            player.set_hand(m.deal.hand);
+            break;
+        case ServerMessageType::TAKEN:
+            player.set_game_may_be_over(0);
+            // also right after reconnecting, when TAKEN lists tricks we did not see
+            for (Card c: m.taken.cards) {
+                player.remove_card(c);
+            }
+            break;
+        case ServerMessageType::SCORE:
+        case ServerMessageType::TOTAL:
+            player.set_game_may_be_over(player.get_game_may_be_over() + 1);
+            break;
+        default:
+            player.set_game_may_be_over(0);
+            break;
+    }
+
+    printer.add_report_log_to_client(line, addresses.server_ip, addresses.server_port,
+                                     addresses.client_ip, addresses.client_port);
+    if (!answer.view().empty()) {
+        printer.add_report_log_from_client(answer.view(), addresses.server_ip, addresses.server_port,
+                                           addresses.client_ip, addresses.client_port);
+    }
+    return 0;
+}
+
+// Plays without stdin, writing the report of all messages to stdout.
 int play_automatic(const Client_Options& options) {
-    Player player = Player(char_to_position.at(options.get_position()));
+    ClientPlayer player = ClientPlayer(static_cast<Position>(char_to_position_no(options.get_position())));
     int sock = connect_to_server(options);
-
+    if (sock == -1) {
+        return 1;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    ConnectionAddresses addresses;
+    if (get_connection_addresses(sock, addresses) < 0) {
+        std::cerr << "Error: cannot get the connection's addresses\n";
+        return 1;
+    }
+    ReportPrinter printer;
+    MessageBuilder iam;
+    iam.append("IAM").append(options.get_position()).end_line();
+    if (send_automatic(sock, iam.view(), addresses, printer) < 0) {
+        return 1;
+    }
+    int result = receive_messages(sock, player, [&](std::string_view line) {
+        return process_automatic_message(line, player, sock, addresses, printer);
+    });
+    close(sock);
+    return result == 0 ? 0 : 1;
 }
 
 int play_manual(const Client_Options& options) {
-    ClientPlayer player = ClientPlayer(char_to_position.at(options.get_position()));
+    ClientPlayer player = ClientPlayer(static_cast<Position>(char_to_position_no(options.get_position())));
     int sock = connect_to_server(options);
     if (sock == -1) {
         return 1;
@@ -577,7 +654,10 @@ int play_manual(const Client_Options& options) {
         return 1;
     }
     player.start_client_commands_thread(sock);
-    receive_messages(sock, player);
+    receive_messages(sock, player, [&player](std::string_view line) {
+        process_message(line.substr(0, line.size() - 2), player);
+        return 0;
+    });
 
 
     return 0;
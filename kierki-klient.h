@@ -9,7 +9,9 @@
 #include <cinttypes>
 #include <set>
 #include <vector>
+#include <mutex>
 #include "cards.h"
+#include "strategy.h"
 
 
 class Client_Options {
@@ -35,7 +37,7 @@ public:
 class ClientTrick;
 
 class ClientPlayer {
-    std::set<Card> hand;
+    CardSet hand;
     Position position;
     std::vector<ClientTrick> taken_tricks;
     std::mutex cards_mutex;
@@ -56,11 +58,11 @@ public:
     [[nodiscard]] bool has_card_of_color(card_color_t c) const;
     [[nodiscard]] Card get_biggest_of_color(card_color_t c) const;
     [[nodiscard]] Card get_biggest_smaller_than(Card c) const;
-    void set_hand(const std::set<Card>& h);
+    void set_hand(const CardSet& h);
     void set_current_round_type(int t);
     [[nodiscard]] int get_current_round_type() const;
     std::unique_lock<std::mutex> get_cards_lock();
-    [[nodiscard]] std::set<Card> get_hand() const;
+    [[nodiscard]] CardSet get_hand() const;
     void set_play_now(bool p);
     [[nodiscard]] bool get_play_now() const;
     void add_trick(const ClientTrick& t);
@@ -72,17 +74,26 @@ public:
     void start_client_commands_thread(int sock);
     void set_last_played_card(Card c);
     [[nodiscard]] Card get_last_played_card() const;
+    [[nodiscard]] Card choose_automatic_card(const TrickMessage& m) const;
 };
 
-void print_card_set(const std::set<Card>& s);
+// Both ends of the connection to the server, as written in the report.
+struct ConnectionAddresses {
+    std::string client_ip;
+    int client_port;
+    std::string server_ip;
+    int server_port;
+};
+
+void print_card_set(const CardSet& s);
 
-void print_card_vector(const std::vector<Card>& v);
+void print_card_vector(std::span<const Card> v);
 
 class ClientTrick {
     std::vector<Card> played_cards;
 
 public:
-    explicit ClientTrick(const std::vector<Card>& played_cards);
+    explicit ClientTrick(std::span<const Card> played_cards);
     void set_played_cards(const std::vector<Card>& c);
     void print_trick() const;
 
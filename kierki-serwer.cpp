@@ -5,45 +5,31 @@
 #include <string>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <cstring>
-#include <fstream>
-#include <thread>
-#include <mutex>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
 #include <boost/program_options.hpp>
 #include <csignal>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
 
-
-#include <condition_variable>
 #include "err.h"
 #include "common.h"
 #include "kierki-serwer.h"
 #include "player.h"
 #include "cards.h"
+#include "event_loop.h"
+#include "table.h"
 
 
-std::mutex g_number_of_threads_mutex;
-std::mutex current_round_mutex;
-std::mutex current_trick_mutex;
-std::condition_variable g_all_players;
-std::condition_variable g_can_use_thread;
-
 namespace po = boost::program_options;
 
 
-bool all_players_connected(Player *players) {
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        std::unique_lock<std::mutex> lock = players[i].get_connection_lock();
-        if (!players[i].is_connected()) {
-            return false;
-        }
-    }
-    return true;
-}
-
-
-Options::Options() : port(0), timeout(5) {}
+Options::Options() : port(0), timeout(5), tables(1), threads(1), log_policy(LogFullPolicy::BLOCK),
+                     high_water(DEFAULT_HIGH_WATER), autoplay(false), bot_grace(0), stats(false) {}
 
 void Options::set_port(uint16_t p) {
     this->port = p;
@@ -57,6 +43,34 @@ void Options::set_timeout(uint32_t t) {
     this->timeout = t;
 }
 
+void Options::set_tables(uint32_t t) {
+    this->tables = t;
+}
+
+void Options::set_threads(uint32_t t) {
+    this->threads = t;
+}
+
+void Options::set_log_policy(LogFullPolicy p) {
+    this->log_policy = p;
+}
+
+void Options::set_high_water(size_t h) {
+    this->high_water = h;
+}
+
+void Options::set_autoplay(bool a) {
+    this->autoplay = a;
+}
+
+void Options::set_bot_grace(uint32_t g) {
+    this->bot_grace = g;
+}
+
+void Options::set_stats(bool s) {
+    this->stats = s;
+}
+
 [[nodiscard]] uint16_t Options::get_port() const {
     return this->port;
 }
@@ -69,195 +83,274 @@ void Options::set_timeout(uint32_t t) {
     return this->timeout;
 }
 
-// Wait for all players to connect.
-// This function is called by the main thread.
-// It waits until all players have connected.
-void wait_for_all_players(Player *players) {
-    std::unique_lock<std::mutex> lock(g_number_of_players_mutex);
-    if (all_players_connected(players)) {
-        return;
-    }
-    g_all_players.wait(lock, [&players] { return all_players_connected(players); });
+[[nodiscard]] uint32_t Options::get_tables() const {
+    return this->tables;
 }
 
-void send_busy(int connection_fd, Player *players, int pos, ReportPrinter &printer, uint16_t server_port,
-               uint16_t client_port, const std::string &client_ip, const std::string &server_interface_ip) {
-    char busy_message[10];
-    int mess_index = static_cast<int>(strlen("BUSY"));
-    memcpy(busy_message, "BUSY", strlen("BUSY"));
+[[nodiscard]] uint32_t Options::get_threads() const {
+    return this->threads;
+}
 
-    for (int j = 0; j < NO_OF_PLAYERS; j++) {
-        if (j == pos) {
-            busy_message[mess_index++] = position_no_to_char.at(j);
-        } else {
-            std::unique_lock<std::mutex> lock = players[j].get_connection_lock();
-            if (players[j].is_connected()) {
-                busy_message[mess_index++] = position_no_to_char.at(j);
-            }
-        }
+[[nodiscard]] LogFullPolicy Options::get_log_policy() const {
+    return this->log_policy;
+}
+
+[[nodiscard]] size_t Options::get_high_water() const {
+    return this->high_water;
+}
+
+[[nodiscard]] bool Options::get_autoplay() const {
+    return this->autoplay;
+}
+
+[[nodiscard]] uint32_t Options::get_bot_grace() const {
+    return this->bot_grace;
+}
+
+[[nodiscard]] bool Options::get_stats() const {
+    return this->stats;
+}
+
+Table &TableWorker::add_table(ReportPrinter &printer, const DealFile &deals, uint32_t timeout,
+                              uint16_t server_port, size_t high_water, bool autoplay, uint32_t bot_grace,
+                              bool stats) {
+    this->tables.push_back(std::make_unique<Table>(this->loop, printer, deals, timeout, server_port, high_water,
+                                                   autoplay, bot_grace, stats));
+    return *this->tables.back();
+}
+
+bool TableWorker::all_tables_finished() const {
+    return std::all_of(this->tables.begin(), this->tables.end(),
+                       [](const std::unique_ptr<Table> &t) { return t->is_finished(); });
+}
+
+void TableWorker::run(const std::function<void()> &on_finished) {
+    while (!this->all_tables_finished()) {
+        this->loop.run_once();
     }
-    busy_message[mess_index++] = '\r';
-    busy_message[mess_index++] = '\n';
-    writen(connection_fd, busy_message, mess_index);
-    std::string busy_message_str(busy_message, mess_index);
-    printer.add_report_log_to_client(busy_message_str, server_interface_ip, server_port, client_ip, client_port);
+    on_finished();
+}
 
-    std::cerr << "Place is occupied" << std::endl;
+// on_finished is called on the worker's thread once all its tables are over.
+void TableWorker::start(std::function<void()> on_finished) {
+    this->thread = std::thread(&TableWorker::run, this, std::move(on_finished));
+}
+
+void TableWorker::join() {
+    this->thread.join();
 }
 
+Acceptor::Acceptor(EventLoop &loop, ReportPrinter &printer, std::vector<Table *> tables, int listening_fd,
+                   uint16_t server_port, uint32_t timeout) :
+        loop(loop), printer(printer), tables(std::move(tables)), listening_fd(listening_fd),
+        server_port(server_port), timeout(timeout), accepting(true) {
+    set_nonblocking(listening_fd);
+    this->loop.add_fd(listening_fd, EPOLLIN, [this](uint32_t) { this->on_accept(); });
+}
 
-void thread_get_player(int connection_fd, int &threads_accepting_new_connections,
-                       Player *players, int timeout, ReportPrinter &printer, uint16_t server_port,
-                       uint16_t client_port, const std::string &client_ip, const std::string &server_interface_ip) {
-    {
-        std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-        threads_accepting_new_connections++;
+// We stop listening for new connections while there are too many
+// connections in the handshake, so that they cannot exhaust descriptors.
+void Acceptor::set_accepting(bool a) {
+    if (this->accepting == a) {
+        return;
     }
+    this->accepting = a;
+    this->loop.modify_fd(this->listening_fd, a ? static_cast<uint32_t>(EPOLLIN) : 0);
+}
 
-    char buffer[MAX_MESSAGE_SIZE + 2];
-    ssize_t current_read = 0;
+void Acceptor::on_accept() {
+    struct sockaddr_in6 client_address{};
+    struct sockaddr_in6 server_address{};
+    socklen_t client_address_len = sizeof client_address;
+    socklen_t server_address_len = sizeof server_address;
+    int connection_fd = accept4(this->listening_fd, (struct sockaddr *) &client_address, &client_address_len,
+                                SOCK_NONBLOCK);
+    if (connection_fd < 0) {
+        return;
+    }
+    // every message is a separate write, so Nagle's algorithm would hold back
+    // the one sent right after another until the client acknowledges it
+    int one = 1;
+    setsockopt(connection_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if (getsockname(connection_fd, (struct sockaddr *) &server_address, &server_address_len) < 0) {
+        close(connection_fd);
+        return;
+    }
+    char client_address_str[INET6_ADDRSTRLEN];
+    if (inet_ntop(AF_INET6, &client_address.sin6_addr, client_address_str, INET6_ADDRSTRLEN) == nullptr) {
+        close(connection_fd);
+        return;
+    }
+    char server_address_str[INET6_ADDRSTRLEN];
+    if (inet_ntop(AF_INET6, &server_address.sin6_addr, server_address_str, INET6_ADDRSTRLEN) == nullptr) {
+        close(connection_fd);
+        return;
+    }
 
-    auto start = std::chrono::high_resolution_clock::now();
+    PendingConnection &connection = this->pending[connection_fd];
+    connection.fd = connection_fd;
+    connection.client_port = ntohs(client_address.sin6_port);
+    connection.client_ip = client_address_str;
+    connection.server_interface_ip = server_address_str;
+    connection.length = 0;
+    connection.leftover.clear();
+    connection.deadline = this->loop.add_timer(std::chrono::seconds(this->timeout),
+                                               [this, connection_fd] { this->finish_handshake(connection_fd); });
+    this->loop.add_fd(connection_fd, EPOLLIN,
+                      [this, connection_fd](uint32_t) { this->on_handshake_readable(connection_fd); });
+    if (this->pending.size() >= MAX_PENDING_CONNECTIONS) {
+        this->set_accepting(false);
+    }
+}
 
-    while (true) {
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        if (elapsed_seconds.count() > timeout) {
-            break;
-        }
-        if (current_read >= MAX_MESSAGE_SIZE) {
-            break;
-        }
-        ssize_t length_read = read(connection_fd, buffer + current_read, 1);
-        if (length_read == 0) {
-            break;
+// Whether the first length bytes of a line can still be the start of IAM.
+static bool could_be_IAM_message(const char *buffer, ssize_t length) {
+    static constexpr char prefix[] = "IAM";
+    for (ssize_t i = 0; i < length && i < I_AM_LENGTH; i++) {
+        bool ok;
+        if (i < 3) {
+            ok = buffer[i] == prefix[i];
+        } else if (i == 3) {
+            ok = char_to_position_no(buffer[i]) >= 0;
+        } else {
+            ok = buffer[i] == (i == 4 ? '\r' : '\n');
         }
-        current_read += length_read;
-        if (buffer[current_read - 1] == '\n' && buffer[current_read - 2] == '\r') {
-            break;
+        if (!ok) {
+            return false;
         }
     }
-    if (buffer[current_read - 1] != '\n' || buffer[current_read - 2] != '\r') {
+    return true;
+}
+
+// Reads whatever the client has sent so far; every readiness event costs a
+// single read, however the client splits IAM. A client that sends too slowly
+// is stopped by the deadline, one that sends something other than IAM is
+// dropped as soon as that is known.
+void Acceptor::on_handshake_readable(int fd) {
+    PendingConnection &connection = this->pending.at(fd);
+    ssize_t length_read = read(fd, connection.buffer + connection.length, MAX_MESSAGE_SIZE - connection.length);
+    if (length_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (length_read <= 0) {
+        this->finish_handshake(fd);
+        return;
+    }
+    connection.length += length_read;
+    char *received_end = connection.buffer + connection.length;
+    char *end = std::search(connection.buffer, received_end, "\r\n", "\r\n" + 2);
+    if (end != received_end) {
+        // whatever follows IAM belongs to the game, the table reads it first
+        connection.leftover.assign(end + 2, received_end);
+        connection.length = end + 2 - connection.buffer;
+        this->finish_handshake(fd);
+    } else if (connection.length >= MAX_MESSAGE_SIZE || !could_be_IAM_message(connection.buffer, connection.length)) {
+        this->finish_handshake(fd);
+    }
+}
+
+void Acceptor::drop_pending(int fd) {
+    PendingConnection &connection = this->pending.at(fd);
+    this->loop.cancel_timer(connection.deadline);
+    this->loop.remove_fd(fd);
+    this->pending.erase(fd);
+    this->set_accepting(true);
+}
+
+// Called when IAM was received, the client stopped sending or the time is up.
+void Acceptor::finish_handshake(int fd) {
+    PendingConnection connection = this->pending.at(fd);
+    this->drop_pending(fd);
+    char *buffer = connection.buffer;
+    ssize_t current_read = connection.length;
+
+    if (current_read < 2 || buffer[current_read - 1] != '\n' || buffer[current_read - 2] != '\r') {
         buffer[current_read++] = '\r';
         buffer[current_read++] = '\n';
     }
     std::string received_message(buffer, current_read);
-    printer.add_report_log_from_client(received_message, server_interface_ip, server_port, client_ip, client_port);
+    this->printer.add_report_log_from_client(received_message, connection.server_interface_ip, this->server_port,
+                                             connection.client_ip, connection.client_port);
 
     if (!check_IAM_message(buffer, current_read)) {
-        {
-            std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-            threads_accepting_new_connections--;
-        }
-        close(connection_fd);
+        close(fd);
         return;
     }
 
-    char place_char = buffer[3];
-    int player_no = char_to_position_no.at(place_char);
-    {
-        std::unique_lock<std::mutex> con_lock = players[player_no].get_connection_lock();
-        if (players[player_no].is_connected()) {
-            con_lock.unlock();
-            {
-                std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-                threads_accepting_new_connections--;
-            }
-            send_busy(connection_fd, players, player_no, printer, server_port, client_port, client_ip,
-                      server_interface_ip);
-            close(connection_fd);
-            return;
-        }
-        players[player_no].set_socket_fd(connection_fd);
-        players[player_no].set_client_ip(client_ip);
-        players[player_no].set_client_port(client_port);
-        players[player_no].set_server_interface_ip(server_interface_ip);
-        // if the game is ongoing, we should send DEAL and TAKEN
-        std::unique_lock<std::mutex> round_lock(current_round_mutex);
-        if (players[player_no].get_current_round() != nullptr) {
-            round_lock.unlock();
-            if (players[player_no].send_deal(printer) == -1) {
-                {
-                    std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-                    threads_accepting_new_connections--;
-                }
-                close(connection_fd);
-                return;
-            }
-
-            for (auto &trick: players[player_no].get_current_round()->get_played_tricks()) {
-                if (players[player_no].send_taken(trick, printer) == -1) {
-                    {
-                        std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-                        threads_accepting_new_connections--;
-                    }
-                    close(connection_fd);
-                    return;
-                }
-            }
-        }
-
-        players[player_no].set_connected(true);
-        {
-            std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-            threads_accepting_new_connections--;
-        }
+    int player_no = char_to_position_no(buffer[3]);
+    Table *table = this->choose_table(player_no);
+    if (table == nullptr) {
+        this->send_busy(connection, player_no);
+        close(fd);
+        return;
     }
-
-    players[player_no].notify_connection();
-    g_all_players.notify_all();
-    g_can_use_thread.notify_all();
+    uint16_t client_port = connection.client_port;
+    std::string client_ip = connection.client_ip;
+    std::string server_interface_ip = connection.server_interface_ip;
+    std::string leftover = std::move(connection.leftover);
+    table->get_loop().post([table, player_no, fd, client_port, client_ip, server_interface_ip, leftover] {
+        table->seat_player(player_no, fd, client_port, client_ip, server_interface_ip, leftover);
+    });
 }
 
-
-void th_accept_connections(int new_connections_fd, Player *players, int timeout,
-                           ReportPrinter &printer, uint16_t server_port) {
-    int threads_accepting_new_connections = 0;
+// Reserves the seat at the table that needs it most: the one with the
+// most seats taken, so that games start (or resume) as soon as possible.
+// Returns nullptr if the seat is taken at every table.
+Table *Acceptor::choose_table(int seat) {
     while (true) {
-        {
-            std::unique_lock<std::mutex> lock(g_number_of_threads_mutex);
-            g_can_use_thread.wait(lock, [threads_accepting_new_connections] {
-                return threads_accepting_new_connections < MAX_ACCEPTING_THREADS;
-            });
-        }
-        struct sockaddr_in6 client_address{};
-        struct sockaddr_in6 server_address{};
-        socklen_t client_address_len = sizeof client_address;
-        socklen_t server_address_len = sizeof server_address;
-        int connection_fd = accept(new_connections_fd, (struct sockaddr *) &client_address, &client_address_len);
-        if (connection_fd < 0) {
-            close(connection_fd);
-            continue;
-        }
-        if (getsockname(connection_fd, (struct sockaddr *) &server_address, &server_address_len) < 0) {
-            close(connection_fd);
-            continue;
-        }
-        if (getpeername(connection_fd, (struct sockaddr *) &server_address, &client_address_len) < 0) {
-            close(connection_fd);
-            continue;
+        Table *best = nullptr;
+        int best_taken = -1;
+        for (Table *table: this->tables) {
+            unsigned taken = table->get_taken_seats();
+            if ((taken & (1u << seat)) != 0 || table->is_game_over()) {
+                continue;
+            }
+            int taken_count = std::popcount(taken);
+            if (taken_count > best_taken) {
+                best = table;
+                best_taken = taken_count;
+            }
         }
-        char client_address_str[INET6_ADDRSTRLEN];
-        if (inet_ntop(AF_INET6, &client_address.sin6_addr, client_address_str, INET6_ADDRSTRLEN) == NULL) {
-            close(connection_fd);
-            continue;
+        if (best == nullptr) {
+            return nullptr;
         }
-        char server_address_str[INET6_ADDRSTRLEN];
-        if (inet_ntop(AF_INET6, &server_address.sin6_addr, server_address_str, INET6_ADDRSTRLEN) == NULL) {
-            close(connection_fd);
-            continue;
+        if (best->reserve_seat(seat)) {
+            return best;
         }
+        // the table changed in the meantime - we look again
+    }
+}
 
-        std::string client_ip(client_address_str);
-        std::string server_interface_ip(server_address_str);
-
+// BUSY lists the seats taken at the first table that is still playing.
+void Acceptor::send_busy(const PendingConnection &connection, int seat) {
+    unsigned taken = 1u << seat;
+    for (Table *table: this->tables) {
+        if (!table->is_game_over()) {
+            taken |= table->get_taken_seats();
+            break;
+        }
+    }
+    MessageBuilder busy_message = create_busy(taken);
+    writen(connection.fd, busy_message.view().data(), busy_message.view().size());
+    this->printer.add_report_log_to_client(busy_message.view(), connection.server_interface_ip, this->server_port,
+                                           connection.client_ip, connection.client_port);
 
-        uint16_t client_port = ntohs(client_address.sin6_port);
+    std::cerr << "Place is occupied" << std::endl;
+}
 
-        std::thread(thread_get_player, connection_fd, std::ref(threads_accepting_new_connections),
-                    players, timeout, std::ref(printer), server_port, client_port, std::ref(client_ip),
-                    std::ref(server_interface_ip)).detach();
+void Acceptor::close_all() {
+    if (this->listening_fd < 0) {
+        return;
+    }
+    while (!this->pending.empty()) {
+        int fd = this->pending.begin()->first;
+        this->drop_pending(fd);
+        close(fd);
     }
+    this->loop.remove_fd(this->listening_fd);
+    close(this->listening_fd);
+    this->listening_fd = -1;
+    this->loop.stop();
 }
 
 
@@ -269,7 +362,18 @@ int get_options(Options &options, int argc, char *argv[]) {
                 ("help,h", "produce help message")
                 ("port,p", po::value<int>()->default_value(0), "set port number")
                 ("filename,f", po::value<std::string>()->required(), "set filename")
-                ("timeout,t", po::value<int>()->default_value(5), "set timeout value");
+                ("timeout,t", po::value<int>()->default_value(5), "set timeout value")
+                ("tables,n", po::value<int>()->default_value(1), "set number of tables played at once")
+                ("threads,j", po::value<int>()->default_value(0),
+                 "set number of threads running the tables (0 - one per core)")
+                ("log-policy", po::value<std::string>()->default_value("block"),
+                 "when the report cannot be printed fast enough: block or drop")
+                ("high-water", po::value<int>()->default_value(DEFAULT_HIGH_WATER),
+                 "set number of bytes a client may leave unread before it is disconnected")
+                ("autoplay", "play a card for a client at once when it is the only legal one")
+                ("bot-grace", po::value<int>()->default_value(0),
+                 "set number of seconds after which a bot plays for a disconnected client (0 - never)")
+                ("stats", "print the number of messages and writes of every table when it finishes");
 
         // Define a variable map to store the parsed options
         po::variables_map vm;
@@ -308,10 +412,41 @@ int get_options(Options &options, int argc, char *argv[]) {
         int port = vm["port"].as<int>();
         std::string filename = vm["filename"].as<std::string>();
         int timeout = vm["timeout"].as<int>();
+        int tables = vm["tables"].as<int>();
+        int threads = vm["threads"].as<int>();
+        int high_water = vm["high-water"].as<int>();
+        if (high_water < 1) {
+            std::cerr << "Error: high-water mark has to be positive.\n";
+            return 1;
+        }
+        int bot_grace = vm["bot-grace"].as<int>();
+        if (bot_grace < 0) {
+            std::cerr << "Error: bot grace period has to be non-negative.\n";
+            return 1;
+        }
+        if (tables < 1 || threads < 0) {
+            std::cerr << "Error: there has to be at least one table and a non-negative number of threads.\n";
+            return 1;
+        }
+        std::string log_policy = vm["log-policy"].as<std::string>();
+        if (log_policy != "block" && log_policy != "drop") {
+            std::cerr << "Error: log policy has to be block or drop.\n";
+            return 1;
+        }
+        if (threads == 0) {
+            threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
 
         options.set_port(port);
         options.set_filename(filename);
         options.set_timeout(timeout);
+        options.set_tables(tables);
+        options.set_threads(std::min(tables, threads));
+        options.set_log_policy(log_policy == "drop" ? LogFullPolicy::DROP : LogFullPolicy::BLOCK);
+        options.set_high_water(high_water);
+        options.set_autoplay(vm.count("autoplay") > 0);
+        options.set_bot_grace(bot_grace);
+        options.set_stats(vm.count("stats") > 0);
         signal(SIGPIPE, SIG_IGN);
 
     } catch (const po::error &ex) {
@@ -367,176 +502,49 @@ int run_server(Options &options) {
 }
 
 
-std::ifstream open_file(const std::string &filename) {
-    std::ifstream file;
-    file.open(filename);
-    if (!file.is_open()) {
-        fatal("Could not open file %s", filename.c_str());
-    }
-    return file;
-}
-
-
-void deal_cards(Player *players, std::string *starting_hands, ReportPrinter &printer) {
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        while (true) {
-            wait_for_all_players(players); // it does not block if all players are already connected
-            if (players[i].send_deal(printer) == 0) {
-                break;
-                // send_deal already set the is_connected of the player to false
-            }
-        }
-        players[i].set_hand(create_card_set_from_string(starting_hands[i]));
-    }
-}
-
-void set_current_round(Player *players, Round *round) {
-    std::unique_lock<std::mutex> lock(current_round_mutex);
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        players[i].set_current_round(round);
-    }
-}
-
-void set_current_trick(Player *players, Trick *trick) {
-    std::unique_lock<std::mutex> lock(current_trick_mutex);
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        players[i].set_current_trick(trick);
-    }
-}
-
-void wait_for_card(Player *players, Position trick_starting_player, int i) {
-    while (true) {
-        wait_for_all_players(players); // it does not block if all players are already connected
-        int result = players[(static_cast<int>(trick_starting_player) + i) % NO_OF_PLAYERS].play_card();
-        if (result == 0) {
-            break;
-        } // play_card already set the is_connected of the player to false if result == -1
-    }
-}
-
-void send_scores(Player *players, Round &round) {
-    std::string score = create_score(round);
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        while (true) {
-            wait_for_all_players(players);
-            if (players[i].send_score(score) == 0) {
-                break;
-            }
-        }
+// Tables are spread over the worker threads round-robin; the main thread
+// accepts connections and finishes once every table is over.
+void game(const Options &options, const DealFile &deals, int new_connections_fd) {
+    EventLoop loop;
+    ReportPrinter printer(options.get_log_policy());
+    std::vector<std::unique_ptr<TableWorker>> workers;
+    std::vector<Table *> tables;
+    for (uint32_t i = 0; i < options.get_threads(); i++) {
+        workers.push_back(std::make_unique<TableWorker>());
     }
-}
-
-void send_total_scores(Player *players, int *total_scores, const Round &round) {
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        total_scores[i] += round.get_score(i);
+    for (uint32_t i = 0; i < options.get_tables(); i++) {
+        TableWorker &worker = *workers[i % workers.size()];
+        tables.push_back(&worker.add_table(printer, deals, options.get_timeout(), options.get_port(),
+                                           options.get_high_water(), options.get_autoplay(),
+                                           options.get_bot_grace(), options.get_stats()));
     }
-    std::string total_score = create_total_score(total_scores);
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        while (true) {
-            wait_for_all_players(players);
-            if (players[i].send_total_score(total_score) == 0) {
-                break;
-            }
-        }
-    }
-}
-
-
-void send_trick_results(Player *players, Trick &trick) {
-    for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        while (true) {
-            wait_for_all_players(players);
-            if (players[i].send_taken(trick) == 0) {
-                break;
-            }
-        }
-    }
-}
-
-void settle_trick(Trick &trick, Player *players,
-                  Position &trick_starting_player,
-                  Round &round, int &current_round_value) {
-    int trick_value = trick.evaluate_trick();
-    Position trick_winner = trick.get_taking_player();
-    players[static_cast<int>(trick_winner)].add_points(trick_value);
-    round.add_points(trick_value, trick_winner);
-    trick_starting_player = trick_winner;
-    current_round_value += trick_value;
-}
-
-void run_tricks(Position trick_starting_player,
-                Player *players, Round &round, int &current_round_value) {
-    for (int j = 1; j <= MAX_HAND_SIZE; j++) { // number of tricks
-        Trick trick = Trick(trick_starting_player, j, round.get_round_type());
-        set_current_trick(players, &trick);
-
-        for (int i = 0; i < NO_OF_PLAYERS; i++) {
-            wait_for_card(players, trick_starting_player, i);
-        }
-        // everybody played a card
-        settle_trick(trick, players, trick_starting_player, round, current_round_value);
-
-        send_trick_results(players, trick);
-        if (current_round_value == max_points_per_round.at(round.get_round_type())) {
-            break;
-        }
-        std::unique_lock<std::mutex> round_lock(current_round_mutex);
-        round.add_trick(trick);
+    Acceptor acceptor(loop, printer, tables, new_connections_fd, options.get_port(), options.get_timeout());
+
+    size_t running_workers = workers.size();
+    for (auto &worker: workers) {
+        worker->start([&loop, &acceptor, &running_workers] {
+            loop.post([&acceptor, &running_workers] {
+                if (--running_workers == 0) {
+                    acceptor.close_all();
+                }
+            });
+        });
     }
-}
-
-
-void game_loop(Player *players, std::ifstream &game_file, int &round_count, int *total_scores, ReportPrinter &printer) {
-    std::string starting_settings;
-    std::string starting_hands[4];
-    while (std::getline(game_file, starting_settings)) { // there is another round!
-        int current_round_value = 0;
-
-        for (int i = 0; i < NO_OF_PLAYERS; i++) {
-            std::getline(game_file, starting_hands[i]);
-        }
-
-        Round round = Round(get_round_type_from_sett(starting_settings),
-                            get_start_pos_from_sett(starting_settings),
-                            starting_hands);
-
-        set_current_round(players, &round);
-        deal_cards(players, starting_hands, printer);
-        round_count++;
-
-        Position trick_starting_player = round.get_starting_player();
-
-        run_tricks(trick_starting_player, players, round, current_round_value);
-
-        send_scores(players, round);
-        send_total_scores(players, total_scores, round);
+    loop.run();
+    for (auto &worker: workers) {
+        worker->join();
     }
 }
 
 
-void game(const Options &options, int new_connections_fd) {
-    Player players[4] = {Player(Position::N, options.get_timeout(), options.get_port()),
-                         Player(Position::E, options.get_timeout(), options.get_port()),
-                         Player(Position::S, options.get_timeout(), options.get_port()),
-                         Player(Position::W, options.get_timeout(), options.get_port())};
-    ReportPrinter printer{};
-    std::ifstream game_file = open_file(options.get_filename());
-    std::thread(th_accept_connections, new_connections_fd, players, options.get_timeout(), std::ref(printer),
-                options.get_port()).detach();
-    wait_for_all_players(players); // if not all players are connected, blocks until they are
-    std::string starting_settings;
-    int round_count = 0;
-    int total_scores[4] = {0, 0, 0, 0};
-    game_loop(players, game_file, round_count, total_scores, printer);
-}
-
-
 int main(int argc, char *argv[]) {
     Options options = Options();
     if (get_options(options, argc, argv) == 1) {
         return 1;
     }
+    // a bad deal file is rejected before the server starts listening
+    DealFile deals(options.get_filename(), std::max(1u, std::thread::hardware_concurrency()));
     int new_connections_fd = run_server(options);
-    game(options, new_connections_fd);
+    game(options, deals, new_connections_fd);
     return 0;
-}
\ No newline at end of file
+}
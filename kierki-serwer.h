@@ -6,29 +6,110 @@
 #define KIERKI_KIERKI_SERWER_H
 
 
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "player.h"
-#define MAX_ACCEPTING_THREADS 10
+#include "event_loop.h"
+#include "table.h"
+#define MAX_PENDING_CONNECTIONS 1024
 #define BUFFER_SIZE 128
 #define I_AM_LENGTH 6
 class Options {
     uint16_t port;
     std::string filename;
     uint32_t timeout;
+    uint32_t tables;
+    uint32_t threads;
+    LogFullPolicy log_policy;
+    size_t high_water;
+    bool autoplay;
+    uint32_t bot_grace;
+    bool stats;
 public:
     Options();
     void set_port(uint16_t p);
     void set_filename(const std::string& f);
     void set_timeout(uint32_t t);
+    void set_tables(uint32_t t);
+    void set_threads(uint32_t t);
+    void set_log_policy(LogFullPolicy p);
+    void set_high_water(size_t h);
+    void set_autoplay(bool a);
+    void set_bot_grace(uint32_t g);
+    void set_stats(bool s);
     [[nodiscard]] uint16_t get_port() const;
     [[nodiscard]] std::string get_filename() const;
     [[nodiscard]] uint32_t get_timeout() const;
+    [[nodiscard]] uint32_t get_tables() const;
+    [[nodiscard]] uint32_t get_threads() const;
+    [[nodiscard]] LogFullPolicy get_log_policy() const;
+    [[nodiscard]] size_t get_high_water() const;
+    [[nodiscard]] bool get_autoplay() const;
+    [[nodiscard]] uint32_t get_bot_grace() const;
+    [[nodiscard]] bool get_stats() const;
 };
 
-bool all_players_connected(const std::vector<Player>& players);
+// A thread running one event loop which hosts some of the tables.
+class TableWorker {
+    EventLoop loop;
+    std::vector<std::unique_ptr<Table>> tables;
+    std::thread thread;
 
-void wait_for_all_players(Player* players);
+    [[nodiscard]] bool all_tables_finished() const;
+    void run(const std::function<void()>& on_finished);
 
-void send_busy(int connection_fd, Player *players, int pos);
+public:
+    TableWorker() = default;
+    TableWorker(const TableWorker&) = delete;
+    TableWorker& operator=(const TableWorker&) = delete;
+    Table& add_table(ReportPrinter& printer, const DealFile& deals, uint32_t timeout, uint16_t server_port,
+                     size_t high_water, bool autoplay, uint32_t bot_grace, bool stats);
+    void start(std::function<void()> on_finished);
+    void join();
+};
+
+// A connection that has not introduced itself with IAM yet.
+struct PendingConnection {
+    int fd;
+    uint16_t client_port;
+    std::string client_ip;
+    std::string server_interface_ip;
+    char buffer[MAX_MESSAGE_SIZE + 2];
+    ssize_t length;
+    std::string leftover; // bytes the client sent right after IAM
+    EventLoop::timer_id deadline;
+};
+
+// Owns the listening socket and all connections in the IAM handshake.
+// Clients that pass the handshake are handed over to a table with their
+// seat free, on the thread that runs that table.
+class Acceptor {
+    EventLoop& loop;
+    ReportPrinter& printer;
+    std::vector<Table*> tables;
+    int listening_fd;
+    uint16_t server_port;
+    uint32_t timeout;
+    bool accepting;
+    std::unordered_map<int, PendingConnection> pending;
+
+    void on_accept();
+    void on_handshake_readable(int fd);
+    void finish_handshake(int fd);
+    void drop_pending(int fd);
+    void set_accepting(bool a);
+    Table* choose_table(int seat);
+    void send_busy(const PendingConnection& connection, int seat);
+
+public:
+    Acceptor(EventLoop& loop, ReportPrinter& printer, std::vector<Table*> tables, int listening_fd,
+             uint16_t server_port, uint32_t timeout);
+    Acceptor(const Acceptor&) = delete;
+    Acceptor& operator=(const Acceptor&) = delete;
+    void close_all();
+};
 
 
 
@@ -0,0 +1,247 @@
+//
+// Created by jan on 15/06/24.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "kierki-sim.h"
+#include "game.h"
+
+
+namespace po = boost::program_options;
+
+Sim_Options::Sim_Options() : games(10000), threads(1), seed(1),
+                             strategies{Strategy::HEURISTIC, Strategy::RANDOM, Strategy::RANDOM, Strategy::RANDOM} {}
+
+void Sim_Options::set_games(uint64_t g) {
+    this->games = g;
+}
+
+void Sim_Options::set_threads(uint32_t t) {
+    this->threads = t;
+}
+
+void Sim_Options::set_seed(uint64_t s) {
+    this->seed = s;
+}
+
+void Sim_Options::set_strategy(int seat, Strategy s) {
+    this->strategies[seat] = s;
+}
+
+uint64_t Sim_Options::get_games() const {
+    return this->games;
+}
+
+uint32_t Sim_Options::get_threads() const {
+    return this->threads;
+}
+
+uint64_t Sim_Options::get_seed() const {
+    return this->seed;
+}
+
+Strategy Sim_Options::get_strategy(int seat) const {
+    return this->strategies[seat];
+}
+
+
+void SimStats::merge(const SimStats &other) {
+    this->games += other.games;
+    this->tricks += other.tricks;
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        this->seats[i].wins += other.seats[i].wins;
+        for (int score = 0; score <= MAX_GAME_SCORE; score++) {
+            this->seats[i].histogram[score] += other.seats[i].histogram[score];
+        }
+    }
+}
+
+
+// Shuffles the deck and deals 13 cards to every player.
+static void deal_cards(Deal &deal, std::mt19937_64 &rng) {
+    int deck[CARDS_IN_DECK];
+    std::iota(deck, deck + CARDS_IN_DECK, 0);
+    std::shuffle(deck, deck + CARDS_IN_DECK, rng);
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        uint64_t mask = 0;
+        for (int j = 0; j < MAX_TRICKS_PER_ROUND; j++) {
+            mask |= uint64_t{1} << deck[i * MAX_TRICKS_PER_ROUND + j];
+        }
+        deal.hands[i] = CardSet(mask);
+    }
+}
+
+// Plays the seven rounds, one of each type, with the first trick of a round
+// led by each player in turn.
+static void play_game(const Sim_Options &options, std::mt19937_64 &rng, SimStats &stats) {
+    Game game;
+    for (int round_type = 1; round_type <= NO_OF_ROUND_TYPES; round_type++) {
+        Deal deal{round_type, static_cast<Position>((round_type - 1) % NO_OF_PLAYERS), {}};
+        deal_cards(deal, rng);
+        game.start_round(deal);
+        while (true) {
+            Position player = game.get_current_player();
+            const Trick &trick = game.get_trick();
+            MoveView view{round_type, trick.get_trick_number(), game.get_hand(player), trick.get_played_cards()};
+            game.play(choose_card(options.get_strategy(static_cast<int>(player)), view, rng));
+            if (game.is_trick_complete()) {
+                stats.tricks++;
+                if (game.is_round_over()) {
+                    break;
+                }
+                game.next_trick();
+            }
+        }
+    }
+
+    const int *totals = game.get_total_scores();
+    int best = *std::min_element(totals, totals + NO_OF_PLAYERS);
+    int winners = static_cast<int>(std::count(totals, totals + NO_OF_PLAYERS, best));
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        stats.seats[i].histogram[std::min(totals[i], MAX_GAME_SCORE)]++;
+        if (totals[i] == best) {
+            stats.seats[i].wins += 1.0 / winners;
+        }
+    }
+    stats.games++;
+}
+
+// Every thread has its own generator seeded from the seed and the thread's
+// index, so a run is reproducible for the same seed and number of threads.
+static void simulate(const Sim_Options &options, uint32_t thread_index, uint64_t games, SimStats &stats) {
+    std::seed_seq seed{options.get_seed(), static_cast<uint64_t>(thread_index)};
+    std::mt19937_64 rng(seed);
+    for (uint64_t i = 0; i < games; i++) {
+        play_game(options, rng, stats);
+    }
+}
+
+// Smallest score such that at least fraction of the games ended with it or less.
+static int percentile(const SeatStats &seat, uint64_t games, double fraction) {
+    auto needed = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(games)));
+    uint64_t seen = 0;
+    for (int score = 0; score <= MAX_GAME_SCORE; score++) {
+        seen += seat.histogram[score];
+        if (seen >= needed && seen > 0) {
+            return score;
+        }
+    }
+    return MAX_GAME_SCORE;
+}
+
+static void print_report(const Sim_Options &options, const SimStats &stats, double seconds) {
+    std::cout << "Played " << stats.games << " games (" << stats.tricks << " tricks) on "
+              << options.get_threads() << " threads in " << std::fixed << std::setprecision(3) << seconds << " s\n";
+    std::cout << std::setprecision(0) << static_cast<double>(stats.games) / seconds << " games/s, "
+              << static_cast<double>(stats.tricks) / seconds << " tricks/s\n\n";
+    std::cout << "seat strategy      mean  stddev  min  p10  p50  p90  max    wins\n";
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        const SeatStats &seat = stats.seats[i];
+        double sum = 0;
+        double sum_of_squares = 0;
+        for (int score = 0; score <= MAX_GAME_SCORE; score++) {
+            sum += static_cast<double>(score) * static_cast<double>(seat.histogram[score]);
+            sum_of_squares += static_cast<double>(score) * score * static_cast<double>(seat.histogram[score]);
+        }
+        auto games = static_cast<double>(stats.games);
+        double mean = sum / games;
+        double stddev = std::sqrt(std::max(0.0, sum_of_squares / games - mean * mean));
+        std::cout << position_text[i] << "    " << std::left << std::setw(10) << strategy_name(options.get_strategy(i))
+                  << std::right << std::setprecision(2) << std::setw(8) << mean << std::setw(8) << stddev
+                  << std::setw(5) << percentile(seat, stats.games, 0.0)
+                  << std::setw(5) << percentile(seat, stats.games, 0.1)
+                  << std::setw(5) << percentile(seat, stats.games, 0.5)
+                  << std::setw(5) << percentile(seat, stats.games, 0.9)
+                  << std::setw(5) << percentile(seat, stats.games, 1.0)
+                  << std::setw(7) << std::setprecision(1) << 100.0 * seat.wins / games << "%\n";
+    }
+}
+
+int get_options(Sim_Options &options, int argc, char *argv[]) {
+    try {
+        po::options_description desc("Allowed options");
+        desc.add_options()
+                ("help,h", "produce help message")
+                ("games,g", po::value<uint64_t>()->default_value(10000), "set number of games to play")
+                ("threads,j", po::value<int>()->default_value(0), "set number of threads (0 - one per core)")
+                ("seed,s", po::value<uint64_t>()->default_value(1), "set seed of the random number generators")
+                ("north,N", po::value<std::string>()->default_value("heuristic"), "set strategy of N: random, lowest or heuristic")
+                ("east,E", po::value<std::string>()->default_value("random"), "set strategy of E")
+                ("south,S", po::value<std::string>()->default_value("random"), "set strategy of S")
+                ("west,W", po::value<std::string>()->default_value("random"), "set strategy of W");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help")) {
+            std::cerr << desc << "\n";
+            return 1;
+        }
+        po::notify(vm);
+
+        if (vm["games"].as<uint64_t>() == 0) {
+            std::cerr << "Error: number of games has to be positive.\n";
+            return 1;
+        }
+        int threads = vm["threads"].as<int>();
+        if (threads < 0) {
+            std::cerr << "Error: number of threads has to be non-negative.\n";
+            return 1;
+        }
+        if (threads == 0) {
+            threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        options.set_games(vm["games"].as<uint64_t>());
+        options.set_threads(threads);
+        options.set_seed(vm["seed"].as<uint64_t>());
+        const char *seats[NO_OF_PLAYERS] = {"north", "east", "south", "west"};
+        for (int i = 0; i < NO_OF_PLAYERS; i++) {
+            Strategy strategy;
+            if (!parse_strategy(vm[seats[i]].as<std::string>(), strategy)) {
+                std::cerr << "Error: unknown strategy " << vm[seats[i]].as<std::string>() << ".\n";
+                return 1;
+            }
+            options.set_strategy(i, strategy);
+        }
+    } catch (const po::error &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    Sim_Options options;
+    if (get_options(options, argc, argv) == 1) {
+        return 1;
+    }
+
+    uint32_t threads = options.get_threads();
+    std::vector<SimStats> stats(threads, SimStats{});
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threads; i++) {
+        uint64_t games = options.get_games() / threads + (i < options.get_games() % threads ? 1 : 0);
+        workers.emplace_back(simulate, std::cref(options), i, games, std::ref(stats[i]));
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    SimStats total{};
+    for (const auto &s: stats) {
+        total.merge(s);
+    }
+    print_report(options, total, elapsed.count());
+    return 0;
+}
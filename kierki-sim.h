@@ -0,0 +1,49 @@
+//
+// Created by jan on 15/06/24.
+//
+
+#ifndef KIERKI_KIERKI_SIM_H
+#define KIERKI_KIERKI_SIM_H
+
+#include <cinttypes>
+#include "cards.h"
+#include "strategy.h"
+
+// Sum of max_points_per_round over the seven rounds of a game.
+#define MAX_GAME_SCORE 200
+
+class Sim_Options {
+    uint64_t games;
+    uint32_t threads;
+    uint64_t seed;
+    Strategy strategies[NO_OF_PLAYERS];
+
+public:
+    Sim_Options();
+    void set_games(uint64_t g);
+    void set_threads(uint32_t t);
+    void set_seed(uint64_t s);
+    void set_strategy(int seat, Strategy s);
+    [[nodiscard]] uint64_t get_games() const;
+    [[nodiscard]] uint32_t get_threads() const;
+    [[nodiscard]] uint64_t get_seed() const;
+    [[nodiscard]] Strategy get_strategy(int seat) const;
+};
+
+// Distribution of one seat's game totals.
+struct SeatStats {
+    double wins; // a game won by several seats counts as a fraction for each
+    uint64_t histogram[MAX_GAME_SCORE + 1];
+};
+
+// Results gathered by one simulation thread, merged at the end.
+struct SimStats {
+    uint64_t games;
+    uint64_t tricks;
+    SeatStats seats[NO_OF_PLAYERS];
+
+    void merge(const SimStats& other);
+};
+
+
+#endif //KIERKI_KIERKI_SIM_H
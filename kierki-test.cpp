@@ -0,0 +1,553 @@
+//
+// Created by jan on 19/06/24.
+//
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "cards.h"
+#include "common.h"
+#include "deal_file.h"
+#include "game.h"
+#include "line_framer.h"
+#include "player.h"
+
+// Checks of the hand-written parsers against the regexes they replaced,
+// of the encoding tables against the maps they replaced, of the client's
+// decoder of server messages, of LineFramer on lines split between reads
+// in every way, of the rejection of malformed deal files, and of the server
+// telling late answers to forced moves from the moves it waits for.
+// Every section counts its failures and prints the first few inputs that failed;
+// the program exits with 1 if anything failed, so that ctest reports it.
+
+static int failures = 0;
+
+static void fail(const std::string& section, const std::string& input, const std::string& what) {
+    if (++failures <= 20) {
+        std::cerr << section << ": " << what << " for \"";
+        for (char c: input) {
+            if (c == '\r') {
+                std::cerr << "\\r";
+            } else if (c == '\n') {
+                std::cerr << "\\n";
+            } else {
+                std::cerr << c;
+            }
+        }
+        std::cerr << "\"\n";
+    }
+}
+
+// Random strings over alphabet, up to max_length long, all starting with prefix.
+static std::vector<std::string> random_strings(std::mt19937_64& rng, const std::string& prefix,
+                                               const std::string& alphabet, size_t max_length, int count) {
+    std::vector<std::string> out;
+    for (int i = 0; i < count; i++) {
+        std::string s = prefix;
+        size_t length = rng() % (max_length + 1);
+        for (size_t j = 0; j < length; j++) {
+            s += alphabet[rng() % alphabet.size()];
+        }
+        out.push_back(s);
+    }
+    return out;
+}
+
+
+// The regexes the server and the client used before parse_trick_message(),
+// parse_taken_message() and check_IAM_message() replaced them.
+const std::regex trick_reference("TRICK((1[0-3])|[123456789])((10|[23456789JQKA])([CDHS])){0,3}");
+const std::regex card_reference("(10|[23456789JQKA])[CDHS]");
+const std::regex IAM_reference("IAM[NESW]\r\n");
+const std::regex taken_reference("TAKEN((1[0-3])|[123456789])((10|[23456789JQKA])([CDHS])){4}([NESW])");
+
+// Cards listed in s, in order, as the card regex finds them.
+static std::vector<Card> reference_cards(const std::string& s) {
+    std::vector<Card> cards;
+    for (auto it = std::sregex_iterator(s.begin(), s.end(), card_reference); it != std::sregex_iterator(); ++it) {
+        size_t i = 0;
+        Card c;
+        parse_card(it->str(), i, c);
+        cards.push_back(c);
+    }
+    return cards;
+}
+
+static void check_trick(const std::string& s) {
+    std::smatch match;
+    bool expected = std::regex_match(s, match, trick_reference);
+    TrickMessage m{};
+    bool accepted = parse_trick_message(s, m);
+    if (accepted != expected) {
+        fail("TRICK", s, expected ? "rejected" : "accepted");
+        return;
+    }
+    if (!accepted) {
+        return;
+    }
+    if (m.trick_number != std::stoi(match[1].str())) {
+        fail("TRICK", s, "wrong trick number");
+        return;
+    }
+    std::vector<Card> expected_cards = reference_cards(s.substr(5 + match[1].length()));
+    if (static_cast<int>(expected_cards.size()) != m.no_cards ||
+        !std::equal(expected_cards.begin(), expected_cards.end(), m.cards)) {
+        fail("TRICK", s, "wrong cards");
+    }
+}
+
+static void test_trick(std::mt19937_64& rng) {
+    const std::vector<std::string> numbers = {"", "0", "1", "9", "10", "11", "13", "14", "19", "01", "100", "x"};
+    const std::vector<std::string> pieces = {"10C", "1", "0", "2H", "AS", "QD", "9S", "10", "1C", "0C",
+                                             "11C", "C", "a", "ah", "10c", "J", "KH"};
+    const std::vector<std::string> tails = {"", "\r", "\n", "\r\n", " ", "X", "0"};
+    std::vector<std::string> inputs;
+    for (const std::string prefix: {"TRICK", "trick", "TRICk", "TRIC", "TAKEN"}) {
+        for (const auto& number: numbers) {
+            for (const auto& tail: tails) {
+                inputs.push_back(prefix + number + tail);
+                for (const auto& a: pieces) {
+                    inputs.push_back(prefix + number + a + tail);
+                    for (const auto& b: pieces) {
+                        inputs.push_back(prefix + number + a + b + tail);
+                    }
+                }
+            }
+        }
+    }
+    // three and four cards, with every trick number 1-14
+    for (int number = 0; number <= 14; number++) {
+        for (const auto& a: pieces) {
+            inputs.push_back("TRICK" + std::to_string(number) + "2H" + a + "AS");
+            inputs.push_back("TRICK" + std::to_string(number) + "2H" + a + "AS" + "10D");
+        }
+    }
+    for (auto& s: random_strings(rng, "TRICK", "0123456789JQKACDHS10", 12, 100000)) {
+        inputs.push_back(std::move(s));
+    }
+    for (auto& s: random_strings(rng, "", "TRICK0123456789jqkaCDHSx\r\n", 14, 20000)) {
+        inputs.push_back(std::move(s));
+    }
+    for (const auto& s: inputs) {
+        check_trick(s);
+    }
+}
+
+static void test_IAM(std::mt19937_64& rng) {
+    std::vector<std::string> inputs = {"IAMN\r\n", "IAME\r\n", "IAMS\r\n", "IAMW\r\n", "IAMX\r\n", "IAMn\r\n",
+                                       "iamN\r\n", "IAMN\n\r", "IAMN\r\r", "IAMN\r", "IAMN", "IAM\r\n",
+                                       "IAMNE\r\n", "IAMN\r\n\r\n", "XIAMN\r\n", ""};
+    for (auto& s: random_strings(rng, "", "IAMNESWnx\r\n", 7, 50000)) {
+        inputs.push_back(std::move(s));
+    }
+    for (auto& s: random_strings(rng, "IAM", "NESWn\r\n", 3, 1000)) {
+        inputs.push_back(std::move(s));
+    }
+    for (const auto& s: inputs) {
+        bool expected = std::regex_match(s, IAM_reference);
+        if (check_IAM_message(s.data(), static_cast<ssize_t>(s.size())) != expected) {
+            fail("IAM", s, expected ? "rejected" : "accepted");
+        }
+    }
+}
+
+
+static void test_taken(std::mt19937_64& rng) {
+    std::vector<std::string> inputs;
+    for (const std::string number: {"", "0", "1", "9", "10", "13", "14", "01"}) {
+        for (const std::string cards: {"", "2H3H4H", "2H3H4H5H", "2H3H4H5H6H", "10C1C2C3C", "2H3H4H10S", "2h3H4H5H"}) {
+            for (const std::string tail: {"", "N", "W", "X", "n", "NN", "N\r\n"}) {
+                inputs.push_back("TAKEN" + number + cards + tail);
+            }
+        }
+    }
+    for (auto& s: random_strings(rng, "TAKEN", "0123456789JQKACDHSNESW10", 16, 100000)) {
+        inputs.push_back(std::move(s));
+    }
+    for (const auto& s: inputs) {
+        std::smatch match;
+        bool expected = std::regex_match(s, match, taken_reference);
+        TakenMessage m{};
+        bool accepted = parse_taken_message(s, m);
+        if (accepted != expected) {
+            fail("TAKEN", s, expected ? "rejected" : "accepted");
+            continue;
+        }
+        if (!accepted) {
+            continue;
+        }
+        std::vector<Card> cards = reference_cards(s.substr(5 + match[1].length(), s.size() - 6 - match[1].length()));
+        if (m.trick_number != std::stoi(match[1].str()) || cards.size() != NO_OF_PLAYERS ||
+            !std::equal(cards.begin(), cards.end(), m.cards) || m.taking_player != static_cast<Position>(char_to_position_no(s.back()))) {
+            fail("TAKEN", s, "wrong contents");
+        }
+    }
+}
+
+struct ServerMessageCase {
+    std::string_view text;
+    bool valid;
+    ServerMessageType type;
+};
+
+static void test_server_messages() {
+    const ServerMessageCase cases[] = {
+            {"BUSYNSW", true, ServerMessageType::BUSY},
+            {"BUSYE", true, ServerMessageType::BUSY},
+            {"BUSY", false, ServerMessageType::UNKNOWN},
+            {"BUSYNN", false, ServerMessageType::UNKNOWN},
+            {"BUSYX", false, ServerMessageType::UNKNOWN},
+            {"DEAL7N2C5C6CJCQCKC4S9S10S8D5HJHQH", true, ServerMessageType::DEAL},
+            {"DEAL1W10C10D10H10S2C2D2H2S3C3D3H3SAS", true, ServerMessageType::DEAL},
+            {"DEAL8N2C5C6CJCQCKC4S9S10S8D5HJHQH", false, ServerMessageType::UNKNOWN},
+            {"DEAL0N2C5C6CJCQCKC4S9S10S8D5HJHQH", false, ServerMessageType::UNKNOWN},
+            {"DEAL7X2C5C6CJCQCKC4S9S10S8D5HJHQH", false, ServerMessageType::UNKNOWN},
+            {"DEAL7N2C2C6CJCQCKC4S9S10S8D5HJHQH", false, ServerMessageType::UNKNOWN},
+            {"DEAL7N2C5C6CJCQCKC4S9S10S8D5HJH", false, ServerMessageType::UNKNOWN},
+            {"DEAL7N2C5C6CJCQCKC4S9S10S8D5HJHQHAH", false, ServerMessageType::UNKNOWN},
+            {"DEAL7", false, ServerMessageType::UNKNOWN},
+            {"TRICK12QS", true, ServerMessageType::TRICK},
+            {"TRICK1", true, ServerMessageType::TRICK},
+            {"TRICK110C5D", true, ServerMessageType::TRICK},
+            {"TRICK0", false, ServerMessageType::UNKNOWN},
+            {"TRICK12H3H4H5H", false, ServerMessageType::UNKNOWN},
+            {"WRONG7", true, ServerMessageType::WRONG},
+            {"WRONG13", true, ServerMessageType::WRONG},
+            {"WRONG", false, ServerMessageType::UNKNOWN},
+            {"WRONGx", false, ServerMessageType::UNKNOWN},
+            {"WRONG7x", false, ServerMessageType::UNKNOWN},
+            {"TAKEN1310H2C3CAHE", true, ServerMessageType::TAKEN},
+            {"TAKEN1310H2C3CAH", false, ServerMessageType::UNKNOWN},
+            {"SCOREN0E5S10W123", true, ServerMessageType::SCORE},
+            {"TOTALW1S2E3N4", true, ServerMessageType::TOTAL},
+            {"SCOREN0E5S10", false, ServerMessageType::UNKNOWN},
+            {"SCOREN0N5S10W1", false, ServerMessageType::UNKNOWN},
+            {"SCOREN0E5S10W", false, ServerMessageType::UNKNOWN},
+            {"SCOREN0E5S10Wx", false, ServerMessageType::UNKNOWN},
+            {"TOTALN99999999999E0S0W0", false, ServerMessageType::UNKNOWN},
+            {"HELLO", false, ServerMessageType::UNKNOWN},
+            {"", false, ServerMessageType::UNKNOWN},
+    };
+    for (const auto& c: cases) {
+        ServerMessage m{};
+        if (parse_server_message(c.text, m) != c.valid || m.type != c.type) {
+            fail("server message", std::string(c.text), c.valid ? "rejected" : "accepted");
+        }
+        // no prefix of a message may read past its end, whether it parses or not
+        for (size_t length = 0; length < c.text.size(); length++) {
+            std::string prefix(c.text.substr(0, length));
+            parse_server_message(prefix, m);
+        }
+    }
+
+    ServerMessage m{};
+    if (!parse_server_message("SCOREN0E5S10W123", m) || m.score.scores[0] != 0 || m.score.scores[1] != 5 ||
+        m.score.scores[2] != 10 || m.score.scores[3] != 123) {
+        fail("server message", "SCOREN0E5S10W123", "wrong scores");
+    }
+    if (!parse_server_message("TOTALW1S2E3N4", m) || m.score.scores[0] != 4 || m.score.scores[3] != 1) {
+        fail("server message", "TOTALW1S2E3N4", "wrong scores");
+    }
+    if (!parse_server_message("BUSYNSW", m) || m.busy.seats != 0b1101) {
+        fail("server message", "BUSYNSW", "wrong seats");
+    }
+    if (!parse_server_message("DEAL7E2C5C6CJCQCKC4S9S10S8D5HJHQH", m) || m.deal.round_type != 7 ||
+        m.deal.starting_player != Position::E || m.deal.hand.size() != MAX_TRICKS_PER_ROUND ||
+        !m.deal.hand.contains(Card(card_color_t::S, card_value_t::TEN))) {
+        fail("server message", "DEAL7E2C5C6CJCQCKC4S9S10S8D5HJHQH", "wrong deal");
+    }
+    if (!parse_server_message("TRICK110C5D", m) || m.trick.trick_number != 1 || m.trick.no_cards != 2 ||
+        !(m.trick.cards[0] == Card(card_color_t::C, card_value_t::TEN))) {
+        fail("server message", "TRICK110C5D", "wrong trick");
+    }
+    if (!parse_server_message("TAKEN1310H2C3CAHE", m) || m.taken.trick_number != 13 ||
+        m.taken.taking_player != Position::E || !(m.taken.cards[3] == Card(card_color_t::H, card_value_t::A))) {
+        fail("server message", "TAKEN1310H2C3CAHE", "wrong taken");
+    }
+    if (!parse_server_message("WRONG13", m) || m.wrong.trick_number != 13) {
+        fail("server message", "WRONG13", "wrong trick number");
+    }
+}
+
+// The maps the encoding tables in cards.h replaced.
+const std::map<char, card_color_t> color_reference = {{'C', card_color_t::C}, {'D', card_color_t::D},
+                                                      {'H', card_color_t::H}, {'S', card_color_t::S}};
+const std::map<std::string, card_value_t> value_reference = {
+        {"2", card_value_t::TWO}, {"3", card_value_t::THREE}, {"4", card_value_t::FOUR},
+        {"5", card_value_t::FIVE}, {"6", card_value_t::SIX}, {"7", card_value_t::SEVEN},
+        {"8", card_value_t::EIGHT}, {"9", card_value_t::NINE}, {"10", card_value_t::TEN},
+        {"J", card_value_t::J}, {"Q", card_value_t::Q}, {"K", card_value_t::K}, {"A", card_value_t::A}};
+const std::map<char, int> position_reference = {{'N', 0}, {'E', 1}, {'S', 2}, {'W', 3}};
+const std::map<int, int> points_reference = {{1, 13}, {2, 13}, {3, 20}, {4, 16}, {5, 18}, {6, 20}, {7, 100}};
+
+static void test_encoding() {
+    for (int i = 0; i < 256; i++) {
+        char c = static_cast<char>(i);
+        std::string name(1, c);
+        auto color = color_reference.find(c);
+        if (char_to_color(c) != (color == color_reference.end() ? card_color_t::NONE : color->second)) {
+            fail("encoding", name, "wrong color");
+        }
+        auto position = position_reference.find(c);
+        if (char_to_position_no(c) != (position == position_reference.end() ? -1 : position->second)) {
+            fail("encoding", name, "wrong position");
+        }
+        // every string of one and two characters
+        for (int j = -1; j < 256; j++) {
+            std::string text = j < 0 ? name : name + static_cast<char>(j);
+            auto value = value_reference.find(text);
+            if (string_to_value(text) != (value == value_reference.end() ? card_value_t::NONE : value->second)) {
+                fail("encoding", text, "wrong value");
+            }
+        }
+    }
+    if (string_to_value("") != card_value_t::NONE) {
+        fail("encoding", "", "wrong value");
+    }
+    for (const auto& [round_type, points]: points_reference) {
+        if (max_points_per_round[round_type] != points) {
+            fail("encoding", std::to_string(round_type), "wrong points per round");
+        }
+    }
+    // every card written in a message reads back as itself
+    for (const auto& [color_char, color]: color_reference) {
+        for (const auto& [value_text, value]: value_reference) {
+            Card card(color, value);
+            MessageBuilder message;
+            message.append(card);
+            std::string_view text = message.view();
+            size_t i = 0;
+            Card read;
+            if (text != value_text + color_char || !parse_card(text, i, read) || i != text.size() || !(read == card)) {
+                fail("encoding", std::string(text), "card does not round-trip");
+            }
+        }
+    }
+}
+
+// Feeds bytes to the framer through a socket, one read for every element
+// of reads, and returns the lines found, the line that was too long cut
+// down to what the report shows.
+static std::vector<std::string> frame(LineFramer& framer, const std::vector<std::string>& reads) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        fail("framer", "", "no socketpair");
+        return {};
+    }
+    std::vector<std::string> lines;
+    for (const auto& bytes: reads) {
+        if (write(fds[1], bytes.data(), bytes.size()) != static_cast<ssize_t>(bytes.size()) ||
+            framer.read_from(fds[0]) != static_cast<ssize_t>(bytes.size())) {
+            fail("framer", bytes, "read did not take all the bytes");
+            break;
+        }
+        std::string_view line;
+        FrameStatus status;
+        while ((status = framer.next_line(line)) == FrameStatus::LINE) {
+            lines.emplace_back(line);
+        }
+        if (status == FrameStatus::TOO_LONG) {
+            lines.emplace_back("TOO_LONG " + std::string(framer.cut()));
+            framer.clear();
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return lines;
+}
+
+static void expect_lines(const std::string& name, const std::vector<std::string>& got,
+                         const std::vector<std::string>& expected) {
+    if (got != expected) {
+        fail("framer", name, "wrong lines");
+    }
+}
+
+static void test_framer(std::mt19937_64& rng) {
+    {
+        LineFramer framer;
+        expect_lines("pipelined", frame(framer, {"TRICK12H\r\nTRICK23C\r\nTRICK3"}),
+                     {"TRICK12H\r\n", "TRICK23C\r\n"});
+        expect_lines("pipelined rest", frame(framer, {"AS\r\n"}), {"TRICK3AS\r\n"});
+    }
+    {
+        LineFramer framer;
+        expect_lines("CR|LF", frame(framer, {"TRICK1QH\r", "\nTRICK2", "\r", "\n"}),
+                     {"TRICK1QH\r\n", "TRICK2\r\n"});
+        expect_lines("lone CR and LF", frame(framer, {"A\rB\nC\n\r", "\n"}), {"A\rB\nC\n\r\n"});
+    }
+    {
+        // the longest line there is, however it is split, and one byte more
+        std::string longest = std::string(MAX_MESSAGE_SIZE - 1, 'a') + "\r\n";
+        std::string too_long = std::string(MAX_MESSAGE_SIZE, 'b') + "\r\n";
+        std::string cut = "TOO_LONG " + too_long.substr(0, MAX_MESSAGE_SIZE - 1);
+        for (size_t split = 1; split < longest.size(); split++) {
+            LineFramer framer;
+            expect_lines("longest line split at " + std::to_string(split),
+                         frame(framer, {longest.substr(0, split), longest.substr(split)}), {longest});
+            LineFramer other;
+            expect_lines("too long line split at " + std::to_string(split),
+                         frame(other, {too_long.substr(0, split), too_long.substr(split)}), {cut});
+        }
+    }
+    {
+        // a line across the end of the ring, so that it is copied into scratch
+        LineFramer framer;
+        std::string filler = std::string(100, 'x') + "\r\n";
+        std::vector<std::string> expected;
+        std::vector<std::string> reads;
+        size_t total = 0;
+        while (total + filler.size() < FRAMER_CAPACITY - 10) {
+            reads.push_back(filler);
+            expected.push_back(filler);
+            total += filler.size();
+        }
+        std::string wrapping = "TRICK13" + std::string(110, 'y') + "\r\n";
+        reads.push_back(wrapping.substr(0, FRAMER_CAPACITY - total + 3));
+        reads.push_back(wrapping.substr(FRAMER_CAPACITY - total + 3));
+        expected.push_back(wrapping);
+        reads.push_back("TRICK1\r\n");
+        expected.push_back("TRICK1\r\n");
+        expect_lines("wrap around", frame(framer, reads), expected);
+    }
+    {
+        // thousands of lines cut into reads of random length, the ring wrapping many times
+        std::string all;
+        std::vector<std::string> expected;
+        for (int i = 0; i < 5000; i++) {
+            std::string line = "TRICK" + std::to_string(i % 13 + 1) + std::string(rng() % 60, i % 7 ? 'H' : '\r') + "\r\n";
+            all += line;
+            expected.push_back(line);
+        }
+        std::vector<std::string> reads;
+        for (size_t pos = 0; pos < all.size();) {
+            size_t n = std::min<size_t>(all.size() - pos, 1 + rng() % 300);
+            reads.push_back(all.substr(pos, n));
+            pos += n;
+        }
+        LineFramer framer;
+        expect_lines("random reads", frame(framer, reads), expected);
+    }
+}
+
+
+// Returns true if a deal file with these contents is accepted. DealFile
+// exits on a bad file, so it is loaded in a child process.
+static bool deal_file_loads(const std::string& contents) {
+    char path[] = "/tmp/kierki-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || writen(fd, contents.data(), contents.size()) != static_cast<ssize_t>(contents.size())) {
+        fail("deal file", contents, "could not write the file");
+        return false;
+    }
+    close(fd);
+    pid_t child = fork();
+    if (child == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDERR_FILENO);
+        DealFile deals(path);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    unlink(path);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void test_deal_file() {
+    const std::string clubs = "2C3C4C5C6C7C8C9C10CJCQCKCAC\n";
+    const std::string diamonds = "2D3D4D5D6D7D8D9D10DJDQDKDAD\n";
+    const std::string rest = "2H3H4H5H6H7H8H9H10HJHQHKHAH\n2S3S4S5S6S7S8S9S10SJSQSKSAS\n";
+    std::vector<std::pair<std::string, bool>> cases = {
+            {"1N\n" + clubs + diamonds + rest, true},
+            // 14 tokens, but only 13 different cards
+            {"1N\n2C" + clubs + diamonds + rest, false},
+            // 14 different cards for N, 12 for E
+            {"1N\nAD" + clubs + "2D3D4D5D6D7D8D9D10DJDQDKD\n" + rest, false},
+            {"1N\n" + clubs.substr(2) + diamonds + rest, false},
+    };
+    for (const auto& [contents, valid]: cases) {
+        if (deal_file_loads(contents) != valid) {
+            fail("deal file", contents, valid ? "valid file rejected" : "bad file accepted");
+        }
+    }
+}
+
+// A forced move of the last round is answered only after the next DEAL and
+// TRICK with the same number were sent: the late answer must not be taken
+// as the move in the new round, the answer that comes after it must.
+static void test_forced_answers() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        fail("forced answers", "", "no socketpair");
+        return;
+    }
+    ReportPrinter printer;
+    Game game;
+    Deal deal{1, Position::N, {}};
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        deal.hands[i] = CardSet(((uint64_t{1} << CARDS_PER_COLOR) - 1) << (i * CARDS_PER_COLOR));
+    }
+    Player player(Position::N, &game, 0);
+    player.set_socket_fd(fds[0]);
+    player.set_connected(true);
+    MessageBuilder deal_message;
+    deal_message.append("DEAL").end_line();
+
+    game.start_round(deal);
+    player.set_current_trick(&game.get_trick());
+    Card forced = deal.hands[0].lowest();
+    if (player.queue_deal(deal_message.view(), printer) < 0 || player.request_card(printer) < 0) {
+        fail("forced answers", "", "could not send");
+    }
+    player.play_forced_card(forced);
+
+    game.start_round(deal);
+    player.set_current_trick(&game.get_trick());
+    if (player.queue_deal(deal_message.view(), printer) < 0 || player.request_card(printer) < 0) {
+        fail("forced answers", "", "could not send");
+    }
+    Card chosen = deal.hands[0].highest();
+    MessageBuilder late;
+    late.append("TRICK").append(1).append(forced).end_line();
+    MessageBuilder answer;
+    answer.append("TRICK").append(1).append(chosen).end_line();
+    std::string input = std::string(late.view()) + std::string(answer.view());
+    writen(fds[1], input.data(), input.size());
+    if (player.read_messages(printer) < 0) {
+        fail("forced answers", input, "player disconnected");
+    } else if (!player.has_played_card()) {
+        fail("forced answers", input, "no card played");
+    } else if (!(player.play_card() == chosen)) {
+        fail("forced answers", input, "late answer taken as the move");
+    } else if (player.awaits_forced_answers()) {
+        fail("forced answers", input, "late answer not recognised");
+    }
+    player.disconnect();
+    close(fds[1]);
+}
+
+int main() {
+    std::mt19937_64 rng(2024);
+    test_trick(rng);
+    test_IAM(rng);
+    test_taken(rng);
+    test_encoding();
+    test_server_messages();
+    test_framer(rng);
+    test_deal_file();
+    test_forced_answers();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
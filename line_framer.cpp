@@ -0,0 +1,89 @@
+//
+// Created by jan on 18/06/24.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include "line_framer.h"
+
+#define FRAMER_MASK (FRAMER_CAPACITY - 1)
+
+LineFramer::LineFramer() : buffer{}, scratch{}, head(0), tail(0), scanned(0) {}
+
+// length bytes starting at from, made contiguous if they wrap around.
+std::string_view LineFramer::view(uint64_t from, size_t length) {
+    size_t start = from & FRAMER_MASK;
+    if (start + length <= FRAMER_CAPACITY) {
+        return {this->buffer + start, length};
+    }
+    size_t first = FRAMER_CAPACITY - start;
+    memcpy(this->scratch, this->buffer + start, first);
+    memcpy(this->scratch + first, this->buffer, length - first);
+    return {this->scratch, length};
+}
+
+// A single read into all the free space, with readv() when it wraps around.
+// Returns what read() returns; -1 with ENOBUFS if the buffer is full.
+ssize_t LineFramer::read_from(int fd) {
+    size_t free_space = FRAMER_CAPACITY - this->size();
+    if (free_space == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    size_t start = this->tail & FRAMER_MASK;
+    size_t first = std::min(free_space, FRAMER_CAPACITY - start);
+    struct iovec iov[2];
+    iov[0].iov_base = this->buffer + start;
+    iov[0].iov_len = first;
+    iov[1].iov_base = this->buffer;
+    iov[1].iov_len = free_space - first;
+    ssize_t bytes_read = readv(fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+    if (bytes_read > 0) {
+        this->tail += bytes_read;
+    }
+    return bytes_read;
+}
+
+// Adds bytes received elsewhere. Returns false if they do not fit.
+bool LineFramer::append(std::string_view bytes) {
+    if (bytes.size() > FRAMER_CAPACITY - this->size()) {
+        return false;
+    }
+    for (char c: bytes) {
+        this->buffer[this->tail++ & FRAMER_MASK] = c;
+    }
+    return true;
+}
+
+// Looks for the end of the next line. Only the first MAX_MESSAGE_SIZE + 1
+// bytes are searched, so a line is never longer than that with its CRLF.
+FrameStatus LineFramer::next_line(std::string_view &line) {
+    uint64_t limit = std::min(this->tail, this->head + MAX_MESSAGE_SIZE + 1);
+    uint64_t i = std::max(this->scanned, this->head + 1);
+    for (; i < limit; i++) {
+        if (this->buffer[i & FRAMER_MASK] == '\n' && this->buffer[(i - 1) & FRAMER_MASK] == '\r') {
+            line = this->view(this->head, i + 1 - this->head);
+            this->head = i + 1;
+            this->scanned = this->head;
+            return FrameStatus::LINE;
+        }
+    }
+    this->scanned = i;
+    // with MAX_MESSAGE_SIZE bytes the next one may still be the LF ending the line
+    return this->size() > MAX_MESSAGE_SIZE ? FrameStatus::TOO_LONG : FrameStatus::INCOMPLETE;
+}
+
+// The start of a line that was too long, as much of it as fits in a message.
+std::string_view LineFramer::cut() {
+    return this->view(this->head, std::min(this->size(), static_cast<size_t>(MAX_MESSAGE_SIZE - 1)));
+}
+
+size_t LineFramer::size() const {
+    return this->tail - this->head;
+}
+
+void LineFramer::clear() {
+    this->head = this->tail = this->scanned = 0;
+}
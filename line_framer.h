@@ -0,0 +1,51 @@
+//
+// Created by jan on 18/06/24.
+//
+
+#ifndef KIERKI_LINE_FRAMER_H
+#define KIERKI_LINE_FRAMER_H
+
+#include <cinttypes>
+#include <string_view>
+#include <sys/types.h>
+#include "common.h"
+
+// Has to be a power of two and leave room for a read after an unfinished line.
+#define FRAMER_CAPACITY 1024
+
+static_assert((FRAMER_CAPACITY & (FRAMER_CAPACITY - 1)) == 0);
+static_assert(FRAMER_CAPACITY >= 2 * MAX_MESSAGE_SIZE);
+
+enum class FrameStatus {
+    LINE,
+    INCOMPLETE, // no CRLF yet, more bytes are needed
+    TOO_LONG,   // the line does not end within MAX_MESSAGE_SIZE + 1 bytes
+};
+
+// Splits a stream of bytes into lines ending with CRLF. Bytes are read
+// straight into a ring buffer and lines are returned as views into it,
+// together with their CRLF; only a line that wraps around the end of the
+// buffer is copied, into scratch. A view is valid until the next call.
+// Every byte is looked at once, however the lines are split between reads.
+class LineFramer {
+    char buffer[FRAMER_CAPACITY];
+    char scratch[MAX_MESSAGE_SIZE + 1];
+    uint64_t head;    // first byte not yet returned
+    uint64_t tail;    // one past the last byte received
+    uint64_t scanned; // no line ends before it
+
+    [[nodiscard]] std::string_view view(uint64_t from, size_t length);
+
+public:
+    LineFramer();
+
+    ssize_t read_from(int fd);
+    bool append(std::string_view bytes);
+    FrameStatus next_line(std::string_view& line);
+    [[nodiscard]] std::string_view cut();
+    [[nodiscard]] size_t size() const;
+    void clear();
+};
+
+
+#endif //KIERKI_LINE_FRAMER_H
@@ -3,288 +3,198 @@
 //
 
 
+#include <cerrno>
 #include <iostream>
-#include <sstream>
-#include <regex>
+#include <sys/uio.h>
+#include <unistd.h>
 #include "player.h"
 #include "err.h"
 #include "cards.h"
 
 
-std::mutex g_number_of_players_mutex;
+Player::Player(Position pos, const Game* game, uint32_t time, int server_port) :
+        position(pos), game(game), connected(false), my_turn(false), card_played(false),
+        played_card(card_color_t::NONE, card_value_t::NONE),
+        forced_cards{}, forced_tricks{}, forced_deals{}, forced_first(0), forced_count(0), deals_sent(0),
+        socket_fd(-1), client_port(0), server_port(server_port), timeout(time),
+        current_trick(nullptr), outbox_size(0), unsent_written(0), unsent_logged(0),
+        high_water(DEFAULT_HIGH_WATER), messages_sent(0), write_calls(0) {}
 
-Player::Player(Position pos, uint32_t time, int server_port) : position(pos), timeout(time),
-                                              played_card(card_color_t::NONE, card_value_t::NONE),
-                                              hand(std::set<Card>()), current_score(0),
-                                                connected(false), socket_fd(-1), my_turn(false),
-                                                card_played(false),
-                                                current_round(nullptr), current_trick(nullptr),
-                                                no_of_cards(0), client_port(0),
-                                                server_port(server_port)
+Player::Player(Position pos, const Game* game, int server_port) :
+        Player(pos, game, DEFAULT_TIMEOUT, server_port) {}
 
-{
-    std::thread(&Player::reading_thread, this).detach();
-}
 
-Player::Player(Position pos, int server_port) : position(pos), timeout(DEFAULT_TIMEOUT), played_card(card_color_t::NONE, card_value_t::NONE),
-                               hand(std::set<Card>()), current_score(0),
-                               connected(false), socket_fd(-1), my_turn(false),
-                               card_played(false),
-                               current_round(nullptr), current_trick(nullptr),
-                               no_of_cards(0), client_port(0),
-                               server_port(server_port)
-{
-    std::thread(&Player::reading_thread, this).detach();
+// Bytes received before the table took the connection over; there are
+// fewer than MAX_MESSAGE_SIZE of them, so they always fit.
+void Player::add_input(std::string_view bytes) {
+    this->input.append(bytes);
 }
 
-
-bool trick_message_is_correct(const std::string &s, std::smatch &match) {
-    std::regex trick_regex(trick_regex_string);
-    return std::regex_match(s, match, trick_regex);
-}
-
-
-
-// This thread should be started after every player is connected first.
-// This is because the condition check !this->connected works well
-// only after disconnection, not before connection.
-void Player::reading_thread(ReportPrinter &printer) {
-
-    std::vector<char> buffer(1024);
-    std::string data;
-    while (true) {
-        {
-            std::unique_lock<std::mutex> lock(this->connection_mutex);
-            if (!this->connected) {
-                // hang until we are connected
-                this->connection_cv.wait(lock, [this] {return this->connected;});
-                // now we are connected again
-            }
-        }
-        ssize_t bytes_read = read(this->socket_fd, buffer.data(), buffer.size());
-        if (bytes_read < 0) {
+// Called by the event loop when the socket is readable.
+// Reads whatever is available and processes every complete line; lines
+// already received are processed even if nothing new can be read.
+// Returns -1 if the connection should be closed, 0 otherwise.
+int Player::read_messages(ReportPrinter &printer) {
+    ssize_t bytes_read = this->input.read_from(this->socket_fd);
+    if (bytes_read < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
             std::cerr << "Error" << std::endl;
-            std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-            data = "";
-            this->connected = false;
-            continue;
-        } else if (bytes_read == 0) {
-            std::cerr << "Connection closed by peer" << std::endl;
-            std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-            data = "";
-            this->connected = false;
-            continue;
-        }
-
-        data.append(buffer.data(), bytes_read);
-        size_t pos;
-        while ((pos = data.find("\r\n")) != std::string::npos) {
-            std::string message = data.substr(0, pos);
-            data.erase(0, pos + 2);
-            std::smatch match;
-            // client sent correct trick message
-            if (trick_message_is_correct(message, match)) {
-                int trick_number = std::stoi(match[1].str());
-                card_value_t value = string_to_value.at(match[4].str());
-                card_color_t color = char_to_color.at(match[5].str()[0]);
-                Card c(color, value);
-
-                std::unique_lock<std::mutex> turn_lock(this->my_turn_mutex);
-
-                if (!this->my_turn || !this->has_card(c) ||
-                    (this->current_trick->get_leading_color() != card_color_t::NONE &&
-                     c.get_color() != this->current_trick->get_leading_color() &&
-                     this->has_card_of_color(this->current_trick->get_leading_color()))) {
-                    // player has to follow the leading color
-                    std::unique_lock<std::mutex> lock_write(this->write_mutex); //tutaj zawieszamy sie
-                    std::stringstream ss_wrong;
-                    ss_wrong << "WRONG";
-                    ss_wrong << this->current_trick->get_trick_number();
-                    ss_wrong << "\r\n";
-                    std::string s_wrong = ss_wrong.str();
-                    auto length = static_cast<ssize_t>(s_wrong.size());
-                    ssize_t managed_to_write = writen(this->socket_fd, s_wrong.c_str(), length);
-                    if (managed_to_write < length) {
-                        std::string short_message = s_wrong.substr(0, managed_to_write);
-                        printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-                        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-                        data = "";
-                        close(this->socket_fd);
-                        this->connected = false;
-                        continue;
-                    }
-                    printer.add_report_log_to_client(s_wrong, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-                    continue;
-                }
-                // can play the card
-                message += "\r\n";
-                printer.add_report_log_from_client(message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-                this->played_card = c;
-                this->card_played = true;
-                this->my_turn = false;
-                turn_lock.unlock();
-                this->card_played_cv.notify_all();
-            } else {
-                // did not receive a correct trick message - we disconnect
-                std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-                close(this->socket_fd);
-                data = "";
-                this->connected = false;
-            }
-        }
-        if (data.length() >= MAX_MESSAGE_SIZE) {
-            std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-            data.substr(0, MAX_MESSAGE_SIZE - 1); // cut the message
-            printer.add_report_log_from_client(data, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-            data = "";
-            close(this->socket_fd);
-            this->connected = false;
-            continue;
+            return -1;
         }
+    } else if (bytes_read == 0) {
+        std::cerr << "Connection closed by peer" << std::endl;
+        return -1;
     }
-}
-
-
-void Player::add_card(Card c) {
-    if (this->no_of_cards == MAX_HAND_SIZE) {
-        fatal("Too many cards in hand");
-    }
-    this->hand.insert(c);
-    this->no_of_cards++;
-}
 
-
-bool Player::has_card(Card c) const {
-    for (const auto &card: this->hand) {
-        if (card.get_color() == c.get_color() && card.get_value() == c.get_value()) {
-            return true;
+    std::string_view line;
+    FrameStatus status;
+    while ((status = this->input.next_line(line)) == FrameStatus::LINE) {
+        if (this->process_message(line, printer) < 0) {
+            return -1;
         }
     }
-    return false;
+    if (status == FrameStatus::TOO_LONG) {
+        printer.add_report_log_from_client(this->input.cut(), this->server_interface_ip, this->server_port,
+                                           this->client_ip, this->client_port);
+        return -1;
+    }
+    return 0;
 }
 
-// Should be called only if has_card(c) is true
-void Player::remove_card(Card c) {
-    if (this->no_of_cards == 0) {
-        fatal("No cards in hand");
+// line ends with CRLF.
+// Returns -1 if the client has to be disconnected, 0 otherwise.
+int Player::process_message(std::string_view line, ReportPrinter &printer) {
+    printer.add_report_log_from_client(line, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+    TrickMessage trick_message{};
+    // did not receive a correct trick message - we disconnect
+    if (!parse_trick_message(line.substr(0, line.size() - 2), trick_message)) {
+        return -1;
     }
-    if (!this->has_card(c)) {
-        fatal("Card not in hand");
+    // the client should send exactly one card; if there are more, we take the last one
+    bool has_card_in_message = trick_message.no_cards > 0;
+    Card c = has_card_in_message ? trick_message.cards[trick_message.no_cards - 1] : Card();
+
+    // the answer to TRICK for a move the server has already made; a move made
+    // before the last DEAL is answered before anything asked in this round,
+    // even if its trick has the same number as the one the client is asked for
+    bool answers_request = this->my_turn && this->current_trick != nullptr &&
+                           trick_message.trick_number == this->current_trick->get_trick_number();
+    if (has_card_in_message && this->take_forced_answer(trick_message.trick_number, c, answers_request)) {
+        return 0;
     }
-    this->hand.erase(c);
-    this->no_of_cards--;
-}
-
-bool Player::has_card_of_color(card_color_t c) const {
-    for (const auto &card: this->hand) {
-        if (card.get_color() == c) {
-            return true;
+    // player has to follow the leading color
+    if (!this->my_turn || this->card_played || !has_card_in_message || !this->get_legal_moves().contains(c)) {
+        MessageBuilder wrong;
+        wrong.append("WRONG");
+        if (this->current_trick != nullptr) {
+            wrong.append(this->current_trick->get_trick_number());
+        } else {
+            wrong.append(trick_message.trick_number);
         }
+        wrong.end_line();
+        return this->send_message(wrong.view(), printer);
     }
-    return false;
+    // can play the card
+    this->played_card = c;
+    this->card_played = true;
+    return 0;
 }
 
-// Should be called only if has_card_of_color(c) is true
-Card Player::get_biggest_of_color(card_color_t c) const {
-    if (!this->has_card_of_color(c)) {
-        return {card_color_t::NONE, card_value_t::NONE};
+// Closes the connection. The caller is responsible for removing
+// the descriptor from the event loop first.
+void Player::disconnect() {
+    if (this->socket_fd >= 0) {
+        close(this->socket_fd);
     }
-    Card biggest(c, card_value_t::TWO);
-    for (const auto &card: this->hand) {
-        if (card.get_color() == c && card < biggest) {
-            biggest = card;
-        }
-    }
-    return biggest;
+    this->socket_fd = -1;
+    this->input.clear();
+    this->outbox_size = 0;
+    this->unsent.clear();
+    this->unsent_lengths.clear();
+    this->unsent_written = 0;
+    this->unsent_logged = 0;
+    this->connected = false;
+    this->my_turn = false;
+    this->card_played = false;
+    this->forced_count = 0;
 }
 
-// Should be called only if has_card_of_color(c) is true
-// Cards are sorted on the  hand, so we know that
-// if we find a card with the same color as c and
-// smaller value than c, it is the biggest card
-// smaller than c by now
 
-Card Player::get_biggest_smaller_than(Card c) const {
-    Card biggest(c.get_color(), card_value_t::TWO);
-    for (const auto &card: this->hand) {
-        if (card.get_color() == c.get_color() && card < c) {
-            biggest = card;
-        }
-    }
-    return biggest;
+// Cards the player may put on the current trick.
+CardSet Player::get_legal_moves() const {
+    return this->game->legal_moves(this->position);
 }
 
 
-int Player::send_trick(ReportPrinter &printer) {
-    std::stringstream ss;
-    ss << "TRICK";
-    ss << current_trick->get_trick_number();
+int Player::queue_trick(ReportPrinter &printer) {
+    this->trick_message.clear();
+    this->trick_message.append("TRICK").append(current_trick->get_trick_number());
     for (const auto &c: current_trick->get_played_cards()) {
-        ss << value_to_string.at(c.get_value());
-        ss << color_to_char.at(c.get_color());
-    }
-    ss << "\r\n";
-    std::string message = ss.str();
-    auto length = static_cast<ssize_t>(message.size());
-    auto managed_to_write = writen(this->socket_fd, message.c_str(), length);
-    if (managed_to_write < length) {
-        std::string short_message = message.substr(0, managed_to_write);
-        printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-        std::cerr << "Connection closed" << std::endl;
-        this->connected = false;
-        return -1;
+        this->trick_message.append(c);
     }
-    printer.add_report_log_to_client(message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-    return 0;
+    this->trick_message.end_line();
+    return this->queue_message(this->trick_message.view(), printer);
 }
 
-// returns 0 if card was played, -1 if connection was closed or we need to ping
-int Player::play_card(ReportPrinter &printer) {
-
-    std::unique_lock<std::mutex> lock_turn(this->my_turn_mutex);
-    my_turn = true;
-    {
-        std::unique_lock<std::mutex> lock_write(this->write_mutex);
-        if (this->send_trick(printer) < 0) {
-            std::cerr << "Connection closed2" << std::endl;
-            return -1;
-        }
-    }
-    // now, since my_turn is set, reading thread may have already received
-    // a proper card and set card_played to true
-
-    if (!this->card_played) {
-        // if we didn't yet, we wait for a card to be played until timeout
-        // reading thread should be running now
-        this->card_played_cv.wait_for(lock_turn, std::chrono::seconds(this->timeout),
-                                      [this] { return this->card_played; });
-    }
-
-    if (!this->card_played) {
-        return -1;
-    }
-
-    current_trick->add_card(this->played_card);
-    this->remove_card(this->played_card);
+// Queues TRICK for the player and marks that we are waiting for their card.
+// Returns 0 on success, -1 if the connection was closed.
+int Player::request_card(ReportPrinter &printer) {
+    this->my_turn = true;
     this->card_played = false;
-    this->my_turn = false;
-    lock_turn.unlock();
-    card_played_cv.notify_all();
-    return 0;
+    return this->queue_trick(printer);
 }
 
-int Player::get_no_of_cards() const {
-    return this->no_of_cards;
+bool Player::has_played_card() const {
+    return this->my_turn && this->card_played;
 }
 
-void Player::set_played_card(Card c) {
-    this->played_card = c;
+// Plays c, the only legal move, for the client after TRICK was queued.
+// The client will most likely still answer, maybe after a few more forced
+// moves or even in the next round; take_forced_answer() recognises it.
+Card Player::play_forced_card(Card c) {
+    this->my_turn = false;
+    this->card_played = false;
+    if (this->forced_count == MAX_FORCED_ANSWERS) {
+        // a client that does not answer forced moves at all
+        this->forced_first = (this->forced_first + 1) % MAX_FORCED_ANSWERS;
+        this->forced_count--;
+    }
+    int last = (this->forced_first + this->forced_count) % MAX_FORCED_ANSWERS;
+    this->forced_cards[last] = c;
+    this->forced_tricks[last] = this->current_trick->get_trick_number();
+    this->forced_deals[last] = this->deals_sent;
+    this->forced_count++;
+    return c;
+}
+
+// Answers come in the order the moves were made. If c in trick_number is one
+// of them, it and every earlier one, never answered, are forgotten.
+// With earlier_deals_only, moves made since the last DEAL are not looked at.
+bool Player::take_forced_answer(int trick_number, Card c, bool earlier_deals_only) {
+    for (int i = 0; i < this->forced_count; i++) {
+        int index = (this->forced_first + i) % MAX_FORCED_ANSWERS;
+        if (earlier_deals_only && this->forced_deals[index] == this->deals_sent) {
+            return false;
+        }
+        if (this->forced_cards[index] == c && this->forced_tricks[index] == trick_number) {
+            this->forced_first = (index + 1) % MAX_FORCED_ANSWERS;
+            this->forced_count -= i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Player::awaits_forced_answers() const {
+    return this->forced_count > 0;
 }
 
-void Player::set_hand(const std::set<Card> &h) {
-    this->hand = h;
-    this->no_of_cards = static_cast<int>(h.size());
+// Should be called only if has_played_card() is true.
+// Returns the card, which has already been checked to be a legal move.
+Card Player::play_card() {
+    this->card_played = false;
+    this->my_turn = false;
+    return this->played_card;
 }
 
 bool Player::is_connected() const {
@@ -295,14 +205,6 @@ void Player::set_connected(bool c) {
     this->connected = c;
 }
 
-void Player::start_reading_thread() {
-    std::thread(&Player::reading_thread, this).detach();
-}
-
-void Player::add_points(int p) {
-    this->current_score += p;
-}
-
 int Player::get_timeout() const {
     return this->timeout;
 }
@@ -324,10 +226,6 @@ int Player::get_server_port() const {
 }
 
 
-int Player::get_current_score() const {
-    return this->current_score;
-}
-
 void Player::set_client_ip(const std::string &ip) {
     this->client_ip = ip;
 }
@@ -344,35 +242,25 @@ void Player::set_server_port(int port) {
     this->server_port = port;
 }
 
-
-std::unique_lock<std::mutex> Player::get_connection_lock() {
-    return std::unique_lock<std::mutex>(this->connection_mutex);
+void Player::set_high_water(size_t bytes) {
+    this->high_water = bytes;
 }
 
-std::unique_lock<std::mutex> Player::get_my_turn_lock() {
-    return std::unique_lock<std::mutex>(this->my_turn_mutex);
-}
 
-std::unique_lock<std::mutex> Player::get_write_lock() {
-    return std::unique_lock<std::mutex>(this->write_mutex);
+int Player::get_socket_fd() const {
+    return this->socket_fd;
 }
 
-
 void Player::set_socket_fd(int fd) {
     this->socket_fd = fd;
 }
 
-void Player::notify_connection() {
-    this->connection_cv.notify_all();
-}
-
-
 Position Player::get_pos() const {
     return this->position;
 }
 
 void Player::print_hand() {
-    for (const auto &card: this->hand) {
+    for (const auto &card: this->game->get_hand(this->position)) {
         card.print_card();
         std::cout << " ";
     }
@@ -380,118 +268,241 @@ void Player::print_hand() {
 }
 
 
-// Returns 0 if sending was successful, -1 if connection was closed, -2 if error occurred
-int Player::send_deal(ReportPrinter &printer) {
-    std::stringstream ss;
-    ss << "DEAL";
-    Round *r = this->current_round;
-    ss << r->get_round_type();
-    ss << position_no_to_char.at(static_cast<int>(r->get_starting_player()));
-    ss << r->get_starting_hand(this->position);
-    ss << "\r\n";
-    std::string message = ss.str();
-    size_t length = message.size();
-    std::unique_lock<std::mutex> lock(this->write_mutex);
-    ssize_t managed_to_write = writen(this->socket_fd, message.c_str(), length);
-    if (managed_to_write < length) { //
-        std::string short_message = message.substr(0, managed_to_write);
-        printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-        this->connected = false;
+// Sends the message to the client; what the socket does not take now is
+// sent once it is writable. Messages are logged once they are written.
+// Returns 0 if sending was successful, -1 if the connection has to be closed.
+int Player::send_message(std::string_view message, ReportPrinter &printer) {
+    if (this->queue_message(message, printer) < 0) {
         return -1;
     }
-    printer.add_report_log_to_client(message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-    return 0;
+    return this->flush(printer);
 }
 
-
-int Player::send_taken(Trick &t, ReportPrinter &printer) {
-    std::stringstream ss;
-    ss << "TAKEN";
-    ss << t.get_trick_number();
-    for (const auto &c: t.get_played_cards()) {
-        ss << value_to_string.at(c.get_value());
-        ss << color_to_char.at(c.get_color());
-    }
-    ss << position_no_to_char.at(static_cast<int>(t.get_taking_player()));
-    ss << "\r\n";
-    std::string message = ss.str();
-    size_t length = message.size();
-    ssize_t managed_to_write = writen(this->socket_fd, message.c_str(), length);
-    if (managed_to_write < length) {
-        std::string short_message = message.substr(0, managed_to_write);
-        printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-        this->connected = false;
+// Adds the message to the ones sent by the next flush(). The message is not
+// copied, so it has to stay unchanged until then.
+// Returns 0 on success, -1 if the connection has to be closed.
+int Player::queue_message(std::string_view message, ReportPrinter &printer) {
+    if (this->outbox_size == MAX_OUTBOX && this->flush(printer) < 0) {
         return -1;
     }
-    printer.add_report_log_to_client(message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+    this->outbox[this->outbox_size++] = message;
     return 0;
 }
 
-std::string create_score(Round& r) {
-    std::stringstream ss;
-    ss << "SCORE";
-    for (int i = 0; i < 4; i++) {
-        ss << position_no_to_char.at(i);
-        ss << r.get_score(i);
+// Copies the queued messages from outbox[first] on to unsent, the first one
+// with written_of_first of its bytes already written.
+void Player::keep_unsent(int first, size_t written_of_first) {
+    if (this->unsent.empty()) {
+        this->unsent_written = written_of_first;
+    }
+    for (int i = first; i < this->outbox_size; i++) {
+        this->unsent.append(this->outbox[i]);
+        this->unsent_lengths.push_back(this->outbox[i].size());
+    }
+    this->outbox_size = 0;
+}
+
+// Logs the messages of unsent that are written completely.
+void Player::log_written(ReportPrinter &printer) {
+    while (!this->unsent_lengths.empty() &&
+           this->unsent_logged + this->unsent_lengths.front() <= this->unsent_written) {
+        std::string_view message(this->unsent.data() + this->unsent_logged, this->unsent_lengths.front());
+        printer.add_report_log_to_client(message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+        this->messages_sent++;
+        this->unsent_logged += this->unsent_lengths.front();
+        this->unsent_lengths.pop_front();
+    }
+    if (this->unsent_written == this->unsent.size()) {
+        this->unsent.clear();
+        this->unsent_written = 0;
+        this->unsent_logged = 0;
+    } else if (this->unsent_logged >= this->unsent.size() / 2) {
+        // a client that never quite catches up must not make unsent grow forever
+        this->unsent.erase(0, this->unsent_logged);
+        this->unsent_written -= this->unsent_logged;
+        this->unsent_logged = 0;
     }
-    ss << "\r\n";
-    return ss.str();
 }
 
+bool Player::over_high_water() const {
+    if (this->unsent.size() - this->unsent_written > this->high_water) {
+        std::cerr << "Client does not read its messages, disconnecting" << std::endl;
+        return true;
+    }
+    return false;
+}
 
-int Player::send_score(const std::string& s, ReportPrinter& printer) {
-    size_t length = s.size();
-    ssize_t managed_to_write = writen(this->socket_fd, s.c_str(), length);
-    if (managed_to_write < length) {
-       std::string short_message = s.substr(0, managed_to_write);
-       printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-        this->connected = false;
-        return -1;
+// Writes all queued messages with one writev() (more only if the socket
+// takes them in parts) and logs them. If the socket is full, the rest waits
+// in unsent for write_unsent(); if the socket is already behind, the
+// messages go straight there, so that they keep their order.
+// Returns 0 on success, -1 if the connection has to be closed.
+int Player::flush(ReportPrinter &printer) {
+    if (!this->unsent.empty()) {
+        this->keep_unsent(0, 0);
+        return this->over_high_water() ? -1 : 0;
+    }
+    iovec iov[MAX_OUTBOX];
+    for (int i = 0; i < this->outbox_size; i++) {
+        iov[i].iov_base = const_cast<char *>(this->outbox[i].data());
+        iov[i].iov_len = this->outbox[i].size();
+    }
+    int first = 0; // the first message not written completely
+    while (first < this->outbox_size) {
+        ssize_t written = writev(this->socket_fd, iov + first, this->outbox_size - first);
+        this->write_calls++;
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            this->keep_unsent(first, this->outbox[first].size() - iov[first].iov_len);
+            return this->over_high_water() ? -1 : 0;
+        }
+        if (written <= 0) {
+            std::string_view message = this->outbox[first];
+            std::string_view short_message = message.substr(0, message.size() - iov[first].iov_len);
+            printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+            std::cerr << "Connection closed" << std::endl;
+            this->outbox_size = 0;
+            return -1;
+        }
+        auto left = static_cast<size_t>(written);
+        while (first < this->outbox_size && left >= iov[first].iov_len) {
+            left -= iov[first].iov_len;
+            printer.add_report_log_to_client(this->outbox[first], this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+            this->messages_sent++;
+            first++;
+        }
+        if (first < this->outbox_size) {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+        }
+    }
+    this->outbox_size = 0;
+    return 0;
+}
+
+// Called when the socket is writable: writes as much of unsent as it takes.
+// Returns 0 on success, -1 if the connection has to be closed.
+int Player::write_unsent(ReportPrinter &printer) {
+    while (this->unsent_written < this->unsent.size()) {
+        ssize_t written = write(this->socket_fd, this->unsent.data() + this->unsent_written,
+                                this->unsent.size() - this->unsent_written);
+        this->write_calls++;
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (written <= 0) {
+            std::string_view short_message(this->unsent.data() + this->unsent_logged,
+                                           this->unsent_written - this->unsent_logged);
+            printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
+            std::cerr << "Connection closed" << std::endl;
+            return -1;
+        }
+        this->unsent_written += written;
+        this->log_written(printer);
     }
-    printer.add_report_log_to_client(s, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
     return 0;
 }
 
-std::string create_total_score(int* total) {
-    std::stringstream ss;
-    ss << "TOTAL";
+bool Player::has_unsent() const {
+    return !this->unsent.empty();
+}
+
+uint64_t Player::get_messages_sent() const {
+    return this->messages_sent;
+}
+
+uint64_t Player::get_write_calls() const {
+    return this->write_calls;
+}
+
+
+// BUSY listing the seats whose bits are set.
+MessageBuilder create_busy(unsigned seats) {
+    MessageBuilder message;
+    message.append("BUSY");
     for (int i = 0; i < NO_OF_PLAYERS; i++) {
-        ss << position_no_to_char.at(i);
-        ss << total[i];
+        if ((seats & (1u << i)) != 0) {
+            message.append(position_text[i]);
+        }
     }
-    ss << "\r\n";
-    return ss.str();
-}
-
-int Player::send_total_score(const std::string& s, ReportPrinter& printer) {
-    size_t length = s.size();
-    ssize_t managed_to_write = writen(this->socket_fd, s.c_str(), length);
-    if (managed_to_write < length) {
-        std::string short_message = s.substr(0, managed_to_write);
-        printer.add_report_log_to_client(short_message, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-        std::unique_lock<std::mutex> lock_conn(this->connection_mutex);
-        this->connected = false;
-        return -1;
+    message.end_line();
+    return message;
+}
+
+MessageBuilder create_deal(const Round &r, Position p) {
+    MessageBuilder message;
+    message.append("DEAL").append(r.get_round_type()).append(r.get_starting_player());
+    message.append(r.get_starting_hand(p));
+    message.end_line();
+    return message;
+}
+
+// Returns 0 if sending was successful, -1 if connection was closed
+int Player::send_deal(std::string_view s, ReportPrinter &printer) {
+    this->deals_sent++;
+    return this->send_message(s, printer);
+}
+
+// Like send_deal(), but leaves the message queued.
+int Player::queue_deal(std::string_view s, ReportPrinter &printer) {
+    this->deals_sent++;
+    return this->queue_message(s, printer);
+}
+
+
+MessageBuilder create_taken(const Trick &t) {
+    MessageBuilder message;
+    message.append("TAKEN").append(t.get_trick_number());
+    for (const auto &c: t.get_played_cards()) {
+        message.append(c);
     }
-    printer.add_report_log_to_client(s, this->server_interface_ip, this->server_port, this->client_ip, this->client_port);
-    return 0;
+    message.append(t.get_taking_player());
+    message.end_line();
+    return message;
 }
 
+int Player::send_taken(const Trick &t, ReportPrinter &printer) {
+    return this->send_message(create_taken(t).view(), printer);
+}
+
+MessageBuilder create_score(const int* scores) {
+    MessageBuilder message;
+    message.append("SCORE");
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        message.append(position_text[i]).append(scores[i]);
+    }
+    message.end_line();
+    return message;
+}
 
 
+int Player::send_score(std::string_view s, ReportPrinter& printer) {
+    return this->send_message(s, printer);
+}
 
-void Player::set_current_round(Round *r) {
-    this->current_round = r;
+MessageBuilder create_total_score(const int* total) {
+    MessageBuilder message;
+    message.append("TOTAL");
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        message.append(position_text[i]).append(total[i]);
+    }
+    message.end_line();
+    return message;
 }
 
-Round *Player::get_current_round() const {
-    return this->current_round;
+int Player::send_total_score(std::string_view s, ReportPrinter& printer) {
+    return this->send_message(s, printer);
 }
 
-void Player::set_current_trick(Trick *t) {
+
+
+
+void Player::set_current_trick(const Trick *t) {
     this->current_trick = t;
 }
 
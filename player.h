@@ -5,97 +5,123 @@
 #ifndef KIERKI_PLAYER_H
 #define KIERKI_PLAYER_H
 
+#include <deque>
 #include "common.h"
 #include "cards.h"
-
-#define MAX_MESSAGE_SIZE 128
-
-extern std::mutex g_number_of_players_mutex;
-
+#include "game.h"
+#include "line_framer.h"
+
+// Messages a Player may have queued at once; more are sent right away.
+#define MAX_OUTBOX 8
+// Bytes a client may leave unread before it is treated as disconnected.
+#define DEFAULT_HIGH_WATER (64 * 1024)
+// Forced moves whose answers a Player remembers; a round has no more.
+#define MAX_FORCED_ANSWERS MAX_TRICKS_PER_ROUND
+
+// Server-side state of one seat at the table.
+// A Player is owned by its Table and is only ever touched from the thread
+// running the table's event loop, so it needs no locking. The cards and the
+// rules live in the table's Game; a Player only talks to its client.
 class Player {
     Position position;
-    std::set<Card> hand;
-    int no_of_cards;
-    int current_score;
+    const Game* game;
     bool connected;
     bool my_turn;
     bool card_played;
     Card played_card;
+    // moves played for the client whose answers are yet to come, oldest first
+    Card forced_cards[MAX_FORCED_ANSWERS];
+    int forced_tricks[MAX_FORCED_ANSWERS];
+    int forced_deals[MAX_FORCED_ANSWERS]; // deals_sent when the move was played
+    int forced_first;
+    int forced_count;
+    int deals_sent; // DEAL messages sent to the client
     int socket_fd;
-    std::mutex connection_mutex;
-    std::condition_variable connection_cv;
-    std::mutex my_turn_mutex;
-    std::mutex write_mutex;
-    std::condition_variable card_played_cv;
+    LineFramer input; // bytes received from the client, not yet split into lines
     std::string client_ip;
     int client_port;
     std::string server_interface_ip;
     int server_port;
 
     uint32_t timeout;
-    Round* current_round;
-    Trick* current_trick;
-    void reading_thread(ReportPrinter &printer);
+    const Trick* current_trick;
+    MessageBuilder trick_message; // the last TRICK, kept until it is sent
+    std::string_view outbox[MAX_OUTBOX]; // queued messages, not yet written
+    int outbox_size;
+    std::string unsent; // bytes the socket did not take, sent once it is writable
+    size_t unsent_written; // how much of unsent is written by now
+    size_t unsent_logged; // where the first message in unsent not logged yet starts
+    std::deque<size_t> unsent_lengths; // lengths of the messages in unsent not logged yet
+    size_t high_water;
+    uint64_t messages_sent;
+    uint64_t write_calls;
+    int process_message(std::string_view line, ReportPrinter& printer);
+    int send_message(std::string_view message, ReportPrinter& printer);
+    void keep_unsent(int first, size_t written_of_first);
+    void log_written(ReportPrinter& printer);
+    [[nodiscard]] bool over_high_water() const;
 
 
 public:
 
-    Player(Position pos, uint32_t time, int server_port);
-    explicit Player(Position pos, int server_port);
+    Player(Position pos, const Game* game, uint32_t time, int server_port);
+    Player(Position pos, const Game* game, int server_port);
 
 
 
     [[nodiscard]] int get_timeout() const;
     [[nodiscard]] Position get_pos() const;
-    [[nodiscard]] int get_no_of_cards() const;
-    [[nodiscard]] int get_current_score() const;
     [[nodiscard]] bool is_connected() const;
     std::string get_client_ip();
     [[nodiscard]] int get_client_port() const;
     std::string get_server_interface_ip();
     [[nodiscard]] int get_server_port() const;
+    [[nodiscard]] int get_socket_fd() const;
 
 
     void set_socket_fd(int fd);
     void set_connected(bool c);
-    void set_played_card(Card c);
 
     void set_client_ip(const std::string& ip);
     void set_client_port(int port);
     void set_server_interface_ip(const std::string& ip);
     void set_server_port(int port);
+    void set_high_water(size_t bytes);
 
 
-    void add_card(Card c);
-    void remove_card(Card c);
-    [[nodiscard]] bool has_card(Card c) const;
-    [[nodiscard]] bool has_card_of_color(card_color_t c) const;
-    [[nodiscard]] Card get_biggest_of_color(card_color_t c) const;
-    [[nodiscard]] Card get_biggest_smaller_than(Card c) const;
-
-    std::unique_lock<std::mutex> get_connection_lock();
-    std::unique_lock<std::mutex> get_my_turn_lock();
-    std::unique_lock<std::mutex> get_write_lock();
+    [[nodiscard]] CardSet get_legal_moves() const;
 
-    void start_reading_thread();
-    void notify_connection();
-    int play_card(ReportPrinter& printer);
-    void set_hand(const std::set<Card>& h);
-    void add_points(int p);
+    void add_input(std::string_view bytes);
+    int read_messages(ReportPrinter& printer);
+    void disconnect();
+    int request_card(ReportPrinter& printer);
+    [[nodiscard]] bool has_played_card() const;
+    Card play_card();
+    Card play_forced_card(Card c);
+    bool take_forced_answer(int trick_number, Card c, bool earlier_deals_only);
+    [[nodiscard]] bool awaits_forced_answers() const;
     void print_hand();
-    int send_deal(ReportPrinter& rp);
-    int send_taken(Trick& t, ReportPrinter& rp);
-    [[nodiscard]] Round * get_current_round() const;
-    void set_current_round(Round *currentRound);
-    [[nodiscard]] int send_trick(ReportPrinter& printer);
-    void set_current_trick(Trick *t);
-    int send_score(const std::string& s, ReportPrinter& printer);
-    int send_total_score(const std::string& s, ReportPrinter& printer);
+    int queue_message(std::string_view message, ReportPrinter& printer);
+    int flush(ReportPrinter& printer);
+    int write_unsent(ReportPrinter& printer);
+    [[nodiscard]] bool has_unsent() const;
+    [[nodiscard]] uint64_t get_messages_sent() const;
+    [[nodiscard]] uint64_t get_write_calls() const;
+    int send_deal(std::string_view s, ReportPrinter& rp);
+    int queue_deal(std::string_view s, ReportPrinter& printer);
+    int send_taken(const Trick& t, ReportPrinter& rp);
+    [[nodiscard]] int queue_trick(ReportPrinter& printer);
+    void set_current_trick(const Trick *t);
+    int send_score(std::string_view s, ReportPrinter& printer);
+    int send_total_score(std::string_view s, ReportPrinter& printer);
 
 };
 
-std::string create_score(Round& r);
-std::string create_total_score(int* total);
+MessageBuilder create_deal(const Round& r, Position p);
+MessageBuilder create_taken(const Trick& t);
+MessageBuilder create_score(const int* scores);
+MessageBuilder create_total_score(const int* total);
+MessageBuilder create_busy(unsigned seats);
 
 
 #endif //KIERKI_PLAYER_H
@@ -0,0 +1,116 @@
+//
+// Created by jan on 15/06/24.
+//
+
+#include "strategy.h"
+
+
+// Orders cards by the points they are worth in the round, then by value.
+static bool less_dangerous(int round_type, Card a, Card b) {
+    int a_points = card_points(round_type, a);
+    int b_points = card_points(round_type, b);
+    if (a_points != b_points) {
+        return a_points < b_points;
+    }
+    return a.num_value() < b.num_value();
+}
+
+// The first card of s that is the least dangerous (or, with most = true,
+// the most dangerous) one. s must not be empty.
+static Card pick(int round_type, CardSet s, bool most) {
+    Card best = *s.begin();
+    for (Card c: s) {
+        if (most ? less_dangerous(round_type, best, c) : less_dangerous(round_type, c, best)) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+// Same as pick(), but among equally dangerous cards takes the highest value.
+static Card pick_safest_high(int round_type, CardSet s) {
+    Card best = *s.begin();
+    for (Card c: s) {
+        int c_points = card_points(round_type, c);
+        int best_points = card_points(round_type, best);
+        if (c_points < best_points || (c_points == best_points && best.num_value() < c.num_value())) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+// Tries not to take tricks: plays just under the card that is taking the
+// trick if it can, and throws away its most dangerous card if it cannot
+// follow the leading color. Runs in a handful of mask operations, so bots
+// answer as soon as they receive a TRICK.
+Card choose_heuristic_card(const MoveView &view) {
+    if (view.trick_cards.empty()) {
+        return pick(view.round_type, view.hand, false);
+    }
+    card_color_t leading_color = view.trick_cards.front().get_color();
+    CardSet following = view.hand.of_color(leading_color);
+    if (following.empty()) {
+        return pick(view.round_type, view.hand, true);
+    }
+    Card taking = view.trick_cards.front();
+    for (Card c: view.trick_cards) {
+        if (c.get_color() == leading_color && taking < c) {
+            taking = c;
+        }
+    }
+    Card below = view.hand.highest_below(taking);
+    if (below.get_color() != card_color_t::NONE) {
+        return below;
+    }
+    // we have to take the trick unless somebody after us plays higher
+    if (view.trick_cards.size() == NO_OF_PLAYERS - 1) {
+        return pick_safest_high(view.round_type, following);
+    }
+    return pick(view.round_type, following, false);
+}
+
+Card choose_card(Strategy strategy, const MoveView &view, std::mt19937_64 &rng) {
+    card_color_t leading_color = view.trick_cards.empty() ? card_color_t::NONE : view.trick_cards.front().get_color();
+    CardSet legal = view.hand.legal_moves(leading_color);
+    switch (strategy) {
+        case Strategy::RANDOM: {
+            auto skip = std::uniform_int_distribution<int>(0, legal.size() - 1)(rng);
+            auto it = legal.begin();
+            while (skip-- > 0) {
+                ++it;
+            }
+            return *it;
+        }
+        case Strategy::LOWEST:
+            return legal.lowest();
+        case Strategy::HEURISTIC:
+            return choose_heuristic_card(view);
+    }
+    return legal.lowest();
+}
+
+bool parse_strategy(std::string_view name, Strategy &strategy) {
+    if (name == "random") {
+        strategy = Strategy::RANDOM;
+    } else if (name == "lowest") {
+        strategy = Strategy::LOWEST;
+    } else if (name == "heuristic") {
+        strategy = Strategy::HEURISTIC;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string_view strategy_name(Strategy strategy) {
+    switch (strategy) {
+        case Strategy::RANDOM:
+            return "random";
+        case Strategy::LOWEST:
+            return "lowest";
+        case Strategy::HEURISTIC:
+            return "heuristic";
+    }
+    return "";
+}
@@ -0,0 +1,38 @@
+//
+// Created by jan on 15/06/24.
+//
+
+#ifndef KIERKI_STRATEGY_H
+#define KIERKI_STRATEGY_H
+
+#include <random>
+#include <span>
+#include <string_view>
+#include "cards.h"
+
+
+// Ways of choosing a card without asking a human.
+enum class Strategy {
+    RANDOM,    // any legal card
+    LOWEST,    // the first legal card in CardSet order
+    HEURISTIC, // avoid taking tricks, get rid of penalty cards
+};
+
+// Everything a player knows when it is their turn.
+struct MoveView {
+    int round_type;
+    int trick_number;
+    CardSet hand;
+    std::span<const Card> trick_cards; // cards already on the table, in the order they were played
+};
+
+Card choose_card(Strategy strategy, const MoveView& view, std::mt19937_64& rng);
+
+Card choose_heuristic_card(const MoveView& view);
+
+bool parse_strategy(std::string_view name, Strategy& strategy);
+
+std::string_view strategy_name(Strategy strategy);
+
+
+#endif //KIERKI_STRATEGY_H
@@ -0,0 +1,430 @@
+//
+// Created by jan on 12/06/24.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "table.h"
+#include "err.h"
+
+
+Table::Table(EventLoop &loop, ReportPrinter &printer, const DealFile &deals, uint32_t timeout,
+             uint16_t server_port, size_t high_water, bool autoplay, uint32_t bot_grace,
+             bool stats) :
+        loop(loop), printer(printer),
+        players{Player(Position::N, &this->game, timeout, server_port),
+                Player(Position::E, &this->game, timeout, server_port),
+                Player(Position::S, &this->game, timeout, server_port),
+                Player(Position::W, &this->game, timeout, server_port)},
+        deals(deals), next_round(0), timeout(timeout), autoplay(autoplay), bot_grace(bot_grace), stats(stats),
+        phase(TablePhase::NEW_ROUND), step(0), current_slot(0), next_prepared(false), round(nullptr),
+        awaiting_card(false), move_timer(0), drain_timer(0), watching_output{}, bot_seats{}, grace_timers{},
+        taken_seats(0), game_over(false), finished(false) {
+    for (auto &player: this->players) {
+        player.set_high_water(high_water);
+    }
+}
+
+// Every seat has a client or the bot in it.
+bool Table::all_seats_played() const {
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        if (!this->players[i].is_connected() && !this->bot_seats[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+EventLoop &Table::get_loop() {
+    return this->loop;
+}
+
+unsigned Table::get_taken_seats() const {
+    return this->taken_seats.load();
+}
+
+bool Table::is_game_over() const {
+    return this->game_over.load();
+}
+
+bool Table::is_finished() const {
+    return this->finished.load();
+}
+
+// Marks the seat as taken, so that no other connection is sent here.
+// Returns false if the seat is already taken or the game is over.
+bool Table::reserve_seat(int seat) {
+    unsigned bit = 1u << seat;
+    unsigned taken = this->taken_seats.load();
+    do {
+        if ((taken & bit) != 0 || this->game_over.load()) {
+            return false;
+        }
+    } while (!this->taken_seats.compare_exchange_weak(taken, taken | bit));
+    return true;
+}
+
+Player &Table::player_to_move() {
+    return this->players[static_cast<int>(this->game.get_current_player())];
+}
+
+// Reads the round after the current one into the free slot, unless it is
+// there already or the deal file has no more rounds.
+void Table::prepare_next_round() {
+    if (this->next_prepared || this->next_round == this->deals.get_no_of_rounds()) {
+        return;
+    }
+    PreparedRound &slot = this->slots[1 - this->current_slot];
+    this->deals.get_deal(this->next_round++, slot.deal, slot.hand_text);
+    slot.round.emplace(slot.deal.round_type, slot.deal.starting_player, slot.hand_text.hands);
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        slot.deal_messages[i] = create_deal(*slot.round, static_cast<Position>(i));
+    }
+    this->next_prepared = true;
+}
+
+// Starts the next round. Returns false if there are no more rounds.
+bool Table::load_round() {
+    this->prepare_next_round();
+    if (!this->next_prepared) {
+        return false;
+    }
+    this->current_slot = 1 - this->current_slot;
+    this->next_prepared = false;
+    PreparedRound &slot = this->slots[this->current_slot];
+    this->round = &*slot.round;
+    this->game.start_round(slot.deal);
+    for (auto &player: this->players) {
+        player.set_current_trick(nullptr);
+    }
+    return true;
+}
+
+void Table::start_trick() {
+    for (auto &player: this->players) {
+        player.set_current_trick(&this->game.get_trick());
+    }
+    this->phase = TablePhase::TRICK;
+    this->step = 0;
+    this->awaiting_card = false;
+}
+
+void Table::request_card() {
+    Player &player = this->player_to_move();
+    int seat = static_cast<int>(player.get_pos());
+    if (this->bot_seats[seat]) {
+        const Trick &trick = this->game.get_trick();
+        MoveView view{this->game.get_round_type(), trick.get_trick_number(), this->game.get_hand(player.get_pos()),
+                      trick.get_played_cards()};
+        this->play_at_once(choose_heuristic_card(view));
+        return;
+    }
+    if (!this->send_to(seat, player.request_card(this->printer))) {
+        return;
+    }
+    CardSet legal_moves = player.get_legal_moves();
+    if (this->autoplay && legal_moves.size() == 1) {
+        // the client still gets TRICK, but there is nothing to wait for
+        this->play_at_once(player.play_forced_card(legal_moves.lowest()));
+        return;
+    }
+    this->awaiting_card = true;
+    this->move_timer = this->loop.add_timer(std::chrono::seconds(this->timeout),
+                                            [this] { this->on_move_timeout(); });
+    // the player is thinking, a good moment to read the next round
+    this->prepare_next_round();
+}
+
+// Plays a card nobody is waited for: a forced move or the bot's.
+void Table::play_at_once(Card card) {
+    this->game.play(card);
+    this->step++;
+    // queued messages point into buffers the next steps write again
+    this->flush_players();
+}
+
+// Nobody took the seat in time - the bot plays it from now on.
+void Table::on_grace_over(int seat) {
+    this->grace_timers[seat] = 0;
+    this->bot_seats[seat] = true;
+    this->advance();
+}
+
+// The player did not answer in time - we send TRICK again.
+void Table::on_move_timeout() {
+    this->awaiting_card = false;
+    this->advance();
+}
+
+// Helper for the send_* results: drops the player if sending failed.
+bool Table::send_to(int seat, int result) {
+    if (result < 0) {
+        this->drop_player(seat);
+        return false;
+    }
+    return true;
+}
+
+// Queues the message for every connected seat.
+void Table::broadcast(std::string_view message) {
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        if (this->players[i].is_connected()) {
+            this->send_to(i, this->players[i].queue_message(message, this->printer));
+        }
+    }
+}
+
+// Sends what the steps queued for every player.
+void Table::flush_players() {
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        if (this->players[i].is_connected() && this->send_to(i, this->players[i].flush(this->printer))) {
+            this->watch_output(i);
+        }
+    }
+}
+
+// Watches the seat's socket for EPOLLOUT exactly while the player has
+// messages the socket did not take.
+void Table::watch_output(int seat) {
+    Player &player = this->players[seat];
+    bool needed = player.has_unsent();
+    if (needed != this->watching_output[seat]) {
+        this->loop.modify_fd(player.get_socket_fd(), EPOLLIN | (needed ? static_cast<uint32_t>(EPOLLOUT) : 0));
+        this->watching_output[seat] = needed;
+    }
+}
+
+void Table::drop_player(int seat) {
+    Player &player = this->players[seat];
+    if (!player.is_connected()) {
+        return;
+    }
+    this->loop.remove_fd(player.get_socket_fd());
+    player.disconnect();
+    this->watching_output[seat] = false;
+    this->taken_seats.fetch_and(~(1u << seat));
+    if (this->awaiting_card && &this->player_to_move() == &player) {
+        // the move will be requested again from whoever takes the seat
+        this->loop.cancel_timer(this->move_timer);
+        this->awaiting_card = false;
+    }
+    if (this->bot_grace > 0 && this->round != nullptr && this->phase != TablePhase::FINISHED) {
+        this->grace_timers[seat] = this->loop.add_timer(std::chrono::seconds(this->bot_grace),
+                                                        [this, seat] { this->on_grace_over(seat); });
+    }
+}
+
+void Table::on_player_event(int seat, uint32_t events) {
+    if (events & EPOLLOUT) {
+        this->on_player_writable(seat);
+    }
+    if ((events & ~EPOLLOUT) != 0 && this->players[seat].is_connected()) {
+        this->on_player_readable(seat);
+    }
+}
+
+void Table::on_player_writable(int seat) {
+    Player &player = this->players[seat];
+    if (!player.is_connected() || !this->send_to(seat, player.write_unsent(this->printer))) {
+        return;
+    }
+    this->watch_output(seat);
+    this->release_if_done(seat);
+}
+
+// After the game a player is let go once it has taken all its messages
+// and answered every TRICK of a move played for it, so that no answer
+// arrives after close() and resets the connection.
+void Table::release_if_done(int seat) {
+    Player &player = this->players[seat];
+    if (this->phase != TablePhase::FINISHED || !player.is_connected() ||
+        player.has_unsent() || player.awaits_forced_answers()) {
+        return;
+    }
+    this->drop_player(seat);
+    if (std::none_of(this->players, this->players + NO_OF_PLAYERS,
+                     [](const Player &p) { return p.is_connected(); })) {
+        this->loop.cancel_timer(this->drain_timer);
+        this->finished.store(true);
+    }
+}
+
+void Table::on_player_readable(int seat) {
+    Player &player = this->players[seat];
+    if (player.read_messages(this->printer) < 0) {
+        this->drop_player(seat);
+        return;
+    }
+    this->watch_output(seat); // an answer to a wrong message may be waiting
+    this->release_if_done(seat);
+    if (player.has_played_card()) {
+        this->loop.cancel_timer(this->move_timer);
+        this->awaiting_card = false;
+        this->game.play(player.play_card());
+        this->step++;
+        this->advance();
+    }
+}
+
+// A player joining an ongoing round gets the DEAL and all TAKEN messages
+// of the tricks played so far.
+int Table::resync_player(int seat) {
+    if (this->round == nullptr || this->phase == TablePhase::NEW_ROUND) {
+        return 0;
+    }
+    Player &player = this->players[seat];
+    if (player.send_deal(this->slots[this->current_slot].deal_messages[seat].view(), this->printer) < 0) {
+        return -1;
+    }
+    for (const Trick &played: this->round->get_played_tricks()) {
+        if (player.send_taken(played, this->printer) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Takes ownership of connection_fd, which must be non-blocking.
+// The seat has to be reserved with reserve_seat() first.
+// leftover are the bytes the client sent together with IAM.
+void Table::seat_player(int seat, int connection_fd, uint16_t client_port,
+                        const std::string &client_ip, const std::string &server_interface_ip,
+                        const std::string &leftover) {
+    Player &player = this->players[seat];
+    if (this->phase == TablePhase::FINISHED) {
+        // the seat was reserved just before the game ended
+        MessageBuilder busy = create_busy(1u << seat);
+        writen(connection_fd, busy.view().data(), busy.view().size());
+        this->printer.add_report_log_to_client(busy.view(), server_interface_ip, player.get_server_port(),
+                                               client_ip, client_port);
+        close(connection_fd);
+        this->taken_seats.fetch_and(~(1u << seat));
+        return;
+    }
+    player.set_socket_fd(connection_fd);
+    player.set_client_ip(client_ip);
+    player.set_client_port(client_port);
+    player.set_server_interface_ip(server_interface_ip);
+    // if the game is ongoing, we should send DEAL and TAKEN
+    if (this->resync_player(seat) < 0) {
+        player.disconnect();
+        this->taken_seats.fetch_and(~(1u << seat));
+        return;
+    }
+    player.set_connected(true);
+    // the seat is handed back, with the cards the bot has left
+    this->loop.cancel_timer(this->grace_timers[seat]);
+    this->grace_timers[seat] = 0;
+    this->bot_seats[seat] = false;
+    this->loop.add_fd(connection_fd, EPOLLIN, [this, seat](uint32_t events) { this->on_player_event(seat, events); });
+    if (!leftover.empty()) {
+        // epoll will not report these bytes again, so they are handled now
+        player.add_input(leftover);
+        this->on_player_readable(seat);
+    }
+    this->advance();
+}
+
+// Performs game steps until the table has to wait for something,
+// then sends the messages they queued.
+void Table::advance() {
+    this->play_steps();
+    this->flush_players();
+}
+
+void Table::play_steps() {
+    while (this->phase != TablePhase::FINISHED && this->all_seats_played()) {
+        switch (this->phase) {
+            case TablePhase::NEW_ROUND:
+                if (!this->load_round()) {
+                    this->finish();
+                    return;
+                }
+                this->phase = TablePhase::DEAL;
+                break;
+            case TablePhase::DEAL: {
+                const PreparedRound &slot = this->slots[this->current_slot];
+                for (int i = 0; i < NO_OF_PLAYERS; i++) {
+                    if (this->players[i].is_connected()) {
+                        this->send_to(i, this->players[i].queue_deal(slot.deal_messages[i].view(), this->printer));
+                    }
+                }
+                this->start_trick();
+                break;
+            }
+            case TablePhase::TRICK:
+                if (this->step == NO_OF_PLAYERS) {
+                    // everybody played a card, the game has scored the trick
+                    this->phase = TablePhase::TAKEN;
+                    break;
+                }
+                if (!this->awaiting_card) {
+                    this->request_card();
+                }
+                if (this->awaiting_card) {
+                    return; // wait for the card or the timeout
+                }
+                break;
+            case TablePhase::TAKEN:
+                this->taken_message = create_taken(this->game.get_trick());
+                this->broadcast(this->taken_message.view());
+                if (this->game.is_round_over()) {
+                    this->score_message = create_score(this->game.get_round_scores());
+                    this->broadcast(this->score_message.view());
+                    this->total_message = create_total_score(this->game.get_total_scores());
+                    this->broadcast(this->total_message.view());
+                    this->phase = TablePhase::NEW_ROUND;
+                    break;
+                }
+                this->round->add_trick(this->game.get_trick());
+                this->game.next_trick();
+                this->start_trick();
+                break;
+            case TablePhase::FINISHED:
+                return;
+        }
+    }
+}
+
+// All rounds are played - we disconnect everybody. Players whose sockets
+// have not taken the last messages yet get up to timeout seconds for them.
+void Table::finish() {
+    this->phase = TablePhase::FINISHED;
+    this->game_over.store(true);
+    this->flush_players(); // the last SCORE and TOTAL
+    for (auto &timer: this->grace_timers) {
+        this->loop.cancel_timer(timer);
+    }
+    if (this->stats) {
+        uint64_t messages = 0;
+        uint64_t writes = 0;
+        for (const auto &player: this->players) {
+            messages += player.get_messages_sent();
+            writes += player.get_write_calls();
+        }
+        std::cerr << "Table finished: " << messages << " messages sent in " << writes << " writes" << std::endl;
+    }
+    bool draining = false;
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        if (this->players[i].has_unsent() || this->players[i].awaits_forced_answers()) {
+            draining = true;
+        } else {
+            this->drop_player(i);
+        }
+    }
+    if (!draining) {
+        this->finished.store(true);
+        return;
+    }
+    this->drain_timer = this->loop.add_timer(std::chrono::seconds(this->timeout), [this] { this->close_table(); });
+}
+
+void Table::close_table() {
+    for (int i = 0; i < NO_OF_PLAYERS; i++) {
+        this->drop_player(i);
+    }
+    this->finished.store(true);
+}
@@ -0,0 +1,129 @@
+//
+// Created by jan on 12/06/24.
+//
+
+#ifndef KIERKI_TABLE_H
+#define KIERKI_TABLE_H
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include "common.h"
+#include "cards.h"
+#include "deal_file.h"
+#include "game.h"
+#include "player.h"
+#include "event_loop.h"
+#include "strategy.h"
+
+
+// Which step of the game the table is going to perform next.
+enum class TablePhase {
+    NEW_ROUND,
+    DEAL,
+    TRICK,
+    TAKEN,
+    FINISHED,
+};
+
+// A round taken from the deal file before it is played, with its DEAL
+// messages ready to be sent. The Round points into hand_text, so a
+// PreparedRound stays where it is; the table reuses two of them.
+struct PreparedRound {
+    Deal deal;
+    HandText hand_text;
+    std::optional<Round> round;
+    MessageBuilder deal_messages[NO_OF_PLAYERS];
+};
+
+// One game of four players, driven entirely by an EventLoop.
+// The game is a state machine: advance() performs as many steps as it can
+// and returns as soon as it has to wait for a card, a timeout or a missing
+// player. Messages are only queued by the steps; advance() sends each
+// player's queue at the end with one writev(), so e.g. TAKEN, SCORE, TOTAL,
+// DEAL and TRICK at the end of a round reach a client in a single write.
+// Sockets never block the table: whatever a client does not take at once
+// is sent when its socket is writable, and a client that leaves more than
+// the high-water mark unread is dropped.
+// The next round is read and its DEAL messages built while the current one
+// waits for cards, so starting a round only takes sending them.
+// With autoplay, a card that is the only legal move is played as soon as
+// TRICK is sent, without waiting for the client; its answer is ignored.
+// With a bot grace period, a seat left empty during the game is played by
+// the heuristic strategy once the period is over, until a client takes the
+// seat again and is sent DEAL and TAKEN like anybody joining mid-round.
+// Only reserve_seat(), get_taken_seats(), is_game_over() and is_finished() may
+// be called from outside the loop's thread; everything else runs on the loop.
+class Table {
+    EventLoop& loop;
+    ReportPrinter& printer;
+    Game game;
+    Player players[NO_OF_PLAYERS];
+    const DealFile& deals;
+    size_t next_round; // index of the round in deals to be played next
+    uint32_t timeout;
+    bool autoplay; // forced moves are played without waiting for the client
+    uint32_t bot_grace; // seconds before the bot takes an empty seat, 0 - never
+    bool stats; // print the messages and writes of the game when it ends
+
+    TablePhase phase;
+    int step; // index of the player (or card in trick) the current phase is at
+    PreparedRound slots[2]; // the round being played and the one after it
+    int current_slot;
+    bool next_prepared; // the other slot holds the next round
+    Round* round; // the round being played, with the tricks taken so far
+    MessageBuilder taken_message;
+    MessageBuilder score_message;
+    MessageBuilder total_message;
+    bool awaiting_card;
+    EventLoop::timer_id move_timer;
+    EventLoop::timer_id drain_timer; // closes the table if the last messages are not taken in time
+    bool watching_output[NO_OF_PLAYERS]; // the seat's socket is watched for EPOLLOUT
+    bool bot_seats[NO_OF_PLAYERS]; // the seat is played by the bot
+    EventLoop::timer_id grace_timers[NO_OF_PLAYERS];
+    std::atomic<unsigned> taken_seats; // bit i is set if seat i is taken or reserved
+    std::atomic<bool> game_over; // all rounds are played, no seat is handed out any more
+    std::atomic<bool> finished;
+
+    [[nodiscard]] bool all_seats_played() const;
+    [[nodiscard]] Player& player_to_move();
+    void prepare_next_round();
+    bool load_round();
+    void start_trick();
+    void request_card();
+    void play_at_once(Card card);
+    void on_grace_over(int seat);
+    void on_move_timeout();
+    void on_player_event(int seat, uint32_t events);
+    void on_player_readable(int seat);
+    void on_player_writable(int seat);
+    void release_if_done(int seat);
+    void watch_output(int seat);
+    bool send_to(int seat, int result);
+    void broadcast(std::string_view message);
+    void flush_players();
+    void play_steps();
+    void drop_player(int seat);
+    int resync_player(int seat);
+    void finish();
+    void close_table();
+
+public:
+    Table(EventLoop& loop, ReportPrinter& printer, const DealFile& deals, uint32_t timeout, uint16_t server_port,
+          size_t high_water, bool autoplay, uint32_t bot_grace, bool stats);
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    [[nodiscard]] EventLoop& get_loop();
+    [[nodiscard]] unsigned get_taken_seats() const;
+    [[nodiscard]] bool is_game_over() const;
+    [[nodiscard]] bool is_finished() const;
+    bool reserve_seat(int seat);
+    void seat_player(int seat, int connection_fd, uint16_t client_port,
+                     const std::string& client_ip, const std::string& server_interface_ip,
+                     const std::string& leftover);
+    void advance();
+};
+
+
+#endif //KIERKI_TABLE_H